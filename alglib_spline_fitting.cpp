@@ -1,30 +1,102 @@
 #include "alglib_spline_fitting.h"
-#include "interpolation.h"
 
 #include <iostream>
 #include <algorithm>
 #include <math.h>
 
-using namespace alglib;
-
 inline double length(const double& x0, const double& y0, const double& x1, const double& y1)
 { 
     return std::sqrt((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0)); 
 }
 
+namespace
+{
+    /* Fit the workspace inputs over the same abscissas [s] with one shared design matrix,
+       the weights of the points are nullptr for an unweighted fitting. */
+    bool shared_fitting(
+        const double* s,
+        size_t n,
+        const double* weights,
+        FitWorkspace& workspace)
+    {
+        asfit::PenalizedSpline& solver = workspace.solver;
+        if(!solver.fitting(s, workspace.inputs, n, workspace.hermites, workspace.reps, weights)){
+            return false;
+        }
+        return workspace.splines.build(workspace.hermites);
+    }
+
+    /* Append the samples t0 + i * step, i = 0, ..., cnt of every spline output to result[offset + k],
+       with derivatives also the rows of asfit::SampleRow, the outputs before offset are the parameter itself. */
+    void sampling(
+        FitWorkspace& workspace,
+        double t0, double step, int cnt,
+        std::vector<std::vector<double>>& result,
+        size_t offset = 0,
+        bool derivatives = false)
+    {
+        const asfit::PiecewiseCubic& splines = workspace.splines;
+        std::vector<double*>& out = workspace.outputs;
+        auto grow = [cnt, &result](size_t row){
+            std::vector<double>& values = result.at(row);
+            size_t first = values.size();
+            values.resize(first + cnt + 1);
+            return values.data() + first;
+        };
+        out.resize(splines.dims());
+        for(size_t k = 0; k < splines.dims(); k++) out[k] = grow(offset + k);
+        if(!derivatives){
+            splines.calc(t0, step, cnt + 1, out);
+            return;
+        }
+
+        // derivatives in the same pass, x' = 1 and x'' = 0 of the parameter
+        if(result.size() < asfit::ROW_NUM) result.resize(asfit::ROW_NUM);
+        asfit::PiecewiseCubic::Derivatives& frame = workspace.derivatives;
+        frame.d1.resize(splines.dims());
+        frame.d2.resize(splines.dims());
+        for(size_t k = 0; k < splines.dims(); k++){
+            frame.d1[k] = grow(asfit::ROW_DX + offset + k);
+            frame.d2[k] = grow(asfit::ROW_DDX + offset + k);
+        }
+        for(size_t k = 0; k < offset; k++){
+            std::fill_n(grow(asfit::ROW_DX + k), cnt + 1, 1.0);
+            std::fill_n(grow(asfit::ROW_DDX + k), cnt + 1, 0.0);
+        }
+        frame.heading = grow(asfit::ROW_HEADING);
+        frame.curvature = grow(asfit::ROW_CURVATURE);
+        frame.x = int(asfit::ROW_X) - int(offset);
+        frame.y = int(asfit::ROW_Y) - int(offset);
+        splines.calc(t0, step, cnt + 1, out, &frame);
+    }
+
+    /* Clear the result of the workspace to rows rows, the buffers keep their capacity. */
+    void reset_result(FitWorkspace& workspace, size_t rows)
+    {
+        if(workspace.result.size() != rows) workspace.result.resize(rows);
+        for(auto& values : workspace.result) values.clear();
+    }
+}
+
 bool AlglibSplineFitting::fitting(
     const std::vector<double>& xarray, 
     const std::vector<double>& yarray, 
     const std::vector<double>& zarray,
     std::vector<std::vector<double>>& result,
     ASFMode mode,
-    double density)
+    double density,
+    const std::vector<double>& warray)
 {
-    if(mode == ASF_PARAM){
-        return fitting_param(xarray, yarray, zarray, result, density); 
-    }else{
-        return fitting_normal(xarray, yarray, zarray, result, density);
+    if(xarray.size() != yarray.size() || yarray.size() != zarray.size()){
+        std::cout << "ERROR.fitting(): x y z size are not equal.\n";
+        return false;
+    }
+    if(!warray.empty() && warray.size() != xarray.size()){
+        std::cout << "ERROR.fitting(): x y z w size are not equal.\n";
+        return false;
     }
+    const double* weights = warray.empty() ? nullptr : warray.data();
+    return fitting(xarray.data(), yarray.data(), zarray.data(), xarray.size(), result, mode, density, weights);
 }
 
 bool AlglibSplineFitting::fitting(
@@ -33,120 +105,196 @@ bool AlglibSplineFitting::fitting(
     const std::vector<double>& zarray,
     const std::vector<double>& sarray,
     std::vector<std::vector<double>>& result,
-    double density)
+    double density,
+    const std::vector<double>& warray)
 {
-    // step 01. check value
-    if(sarray.size() == 0){
-        std::cout << "ERROR.fitting(): sarray.size() is 0.\n";
+    if(xarray.size() != sarray.size() || yarray.size() != sarray.size() || zarray.size() != sarray.size()){
+        std::cout << "ERROR.fitting(): x y z s size are not equal.\n";
+        return false;
+    }
+    if(!warray.empty() && warray.size() != sarray.size()){
+        std::cout << "ERROR.fitting(): x y z s w size are not equal.\n";
         return false;
     }
+    const double* weights = warray.empty() ? nullptr : warray.data();
+    return fitting(xarray.data(), yarray.data(), zarray.data(), sarray.data(), sarray.size(), result, density, weights);
+}
+
+bool AlglibSplineFitting::fitting(
+    const double* xarray, 
+    const double* yarray, 
+    const double* zarray,
+    size_t n,
+    std::vector<std::vector<double>>& result,
+    ASFMode mode,
+    double density,
+    const double* warray)
+{
+    FitWorkspace workspace;
+    if(mode == ASF_PARAM){
+        return fitting_param(xarray, yarray, zarray, warray, n, result, density, workspace); 
+    }else{
+        return fitting_normal(xarray, yarray, zarray, warray, n, result, density, workspace);
+    }
+}
 
-    // step 02. convert to real_1d_array
-    real_1d_array x, y, z, s;
-    int n = xarray.size();
-    x.setcontent(n, xarray.data());
-    y.setcontent(n, yarray.data());
-    z.setcontent(n, zarray.data());
-    s.setcontent(n, sarray.data());
+bool AlglibSplineFitting::fitting(
+    const double* xarray, 
+    const double* yarray, 
+    const double* zarray,
+    const double* sarray,
+    size_t n,
+    std::vector<std::vector<double>>& result,
+    double density,
+    const double* warray)
+{
+    FitWorkspace workspace;
+    return fitting_custom_param(xarray, yarray, zarray, sarray, warray, n, result, density, workspace);
+}
 
-    // step 03. begin spline 1d fit
-    spline1dinterpolant spline_x, spline_y, spline_z;
-    spline1dfitreport rep_x, rep_y, rep_z;
-    spline1dfit(s, x, _base_function_num, _lambdans, spline_x, rep_x);
-    spline1dfit(s, y, _base_function_num, _lambdans, spline_y, rep_y);
-    spline1dfit(s, z, _base_function_num, _lambdans, spline_z, rep_z);
+bool AlglibSplineFitting::fitting(
+    const double* xarray, 
+    const double* yarray, 
+    const double* zarray,
+    size_t n,
+    FitWorkspace& workspace,
+    ASFMode mode,
+    double density,
+    const double* warray)
+{
+    reset_result(workspace, _derivatives ? size_t(asfit::ROW_NUM) : 3);
+    if(mode == ASF_PARAM){
+        return fitting_param(xarray, yarray, zarray, warray, n, workspace.result, density, workspace); 
+    }else{
+        return fitting_normal(xarray, yarray, zarray, warray, n, workspace.result, density, workspace);
+    }
+}
 
-    // step 04. prepare parameters
-    double smin = sarray.front();
-    double smax = sarray.back();
+bool AlglibSplineFitting::fitting(
+    const double* xarray, 
+    const double* yarray, 
+    const double* zarray,
+    const double* sarray,
+    size_t n,
+    FitWorkspace& workspace,
+    double density,
+    const double* warray)
+{
+    reset_result(workspace, _derivatives ? size_t(asfit::ROW_NUM) : 3);
+    return fitting_custom_param(xarray, yarray, zarray, sarray, warray, n, workspace.result, density, workspace);
+}
+
+bool AlglibSplineFitting::fitting(
+    const double* xarray, 
+    const double* yarray, 
+    const double* zarray,
+    size_t n,
+    asfit::ParamSpline3D& spline,
+    ASFMode mode,
+    const double* warray)
+{
+    FitWorkspace workspace;
+    bool success = mode == ASF_PARAM
+        ? fit_param(xarray, yarray, zarray, warray, n, workspace)
+        : fit_normal(xarray, yarray, zarray, warray, n, workspace);
+    return success && spline.build(workspace.splines);
+}
+
+bool AlglibSplineFitting::fitting(
+    const double* xarray, 
+    const double* yarray, 
+    const double* zarray,
+    const double* sarray,
+    size_t n,
+    asfit::ParamSpline3D& spline,
+    const double* warray)
+{
+    FitWorkspace workspace;
+    if(!fit_custom_param(xarray, yarray, zarray, sarray, warray, n, workspace)) return false;
+    return spline.build(workspace.splines);
+}
+
+bool AlglibSplineFitting::fitting_custom_param(
+    const double* xarray, 
+    const double* yarray, 
+    const double* zarray,
+    const double* sarray,
+    const double* warray,
+    size_t n,
+    std::vector<std::vector<double>>& result,
+    double density,
+    FitWorkspace& workspace)
+{
+    // step 01-02. check value, fit x, y and z with the design matrix of s
+    if(!fit_custom_param(xarray, yarray, zarray, sarray, warray, n, workspace)){
+        return false;
+    }
+    if(_arc_length_sampling){
+        if(!workspace.model.build(workspace.splines)) return false;
+        if(result.size() < 3) result.resize(3);
+        return workspace.model.sample_arc_length(density, result, _derivatives, &workspace.sample_buffers);
+    }
+    // step 03. prepare parameters
+    double smin = sarray[0];
+    double smax = sarray[n - 1];
     int cnt = (int)(smax / density);
     double step = (smax - smin) / cnt;
 
-    // step 05. calculate the spline with density
-    result.resize(3, std::vector<double>(0.0));
-    result.at(0).reserve(cnt + 1);
-    result.at(1).reserve(cnt + 1);
-    result.at(2).reserve(cnt + 1);
-    for(int i = 0; i <= cnt; i++){
-        double si = smin + i * step;
-        result.at(0).push_back(spline1dcalc(spline_x, si));
-        result.at(1).push_back(spline1dcalc(spline_y, si));
-        result.at(2).push_back(spline1dcalc(spline_z, si));
-    }
+    // step 04. calculate the spline with density
+    if(result.size() < 3) result.resize(3);
+    sampling(workspace, smin, step, cnt, result, 0, _derivatives);
     return true;
 }
 
 bool AlglibSplineFitting::fitting_param(
-    const std::vector<double>& xarray, 
-    const std::vector<double>& yarray, 
-    const std::vector<double>& zarray,
+    const double* xarray, 
+    const double* yarray, 
+    const double* zarray,
+    const double* warray,
+    size_t n,
     std::vector<std::vector<double>>& result,
-    double density)
+    double density,
+    FitWorkspace& workspace)
 {
-    // step 01. calculate sarray
-    std::vector<double> sarray;
-    if(!calculator(xarray, yarray, sarray)) {
+    // step 01-02. calculate sarray, fit x, y and z with the design matrix of s
+    if(!fit_param(xarray, yarray, zarray, warray, n, workspace)){
         return false;
     }
-
-    // step 02. convert to real_1d_array
-    real_1d_array x, y, z, s;
-    int n = xarray.size();
-    x.setcontent(n, xarray.data());
-    y.setcontent(n, yarray.data());
-    z.setcontent(n, zarray.data());
-    s.setcontent(n, sarray.data());
-
-    // step 03. begin spline 1d fit
-    spline1dinterpolant spline_x, spline_y, spline_z;
-    spline1dfitreport rep_x, rep_y, rep_z;
-    spline1dfit(s, x, _base_function_num, _lambdans, spline_x, rep_x);
-    spline1dfit(s, y, _base_function_num, _lambdans, spline_y, rep_y);
-    spline1dfit(s, z, _base_function_num, _lambdans, spline_z, rep_z);
-
-    // step 04. prepare parameters
+    const std::vector<double>& sarray = workspace.sarray;
+    if(_arc_length_sampling){
+        if(!workspace.model.build(workspace.splines)) return false;
+        if(result.size() < 3) result.resize(3);
+        return workspace.model.sample_arc_length(density, result, _derivatives, &workspace.sample_buffers);
+    }
+    // step 03. prepare parameters
     double smin = 0;
     double smax = sarray.back();
     int cnt = (int)(smax / density);
     double step = (smax - smin) / cnt;
 
-    // step 05. calculate the spline with density
-    result.resize(3, std::vector<double>(0.0));
-    result.at(0).reserve(cnt + 1);
-    result.at(1).reserve(cnt + 1);
-    result.at(2).reserve(cnt + 1);
-    for(int i = 0; i <= cnt; i++){
-        double si = smin + i * step;
-        result.at(0).push_back(spline1dcalc(spline_x, si));
-        result.at(1).push_back(spline1dcalc(spline_y, si));
-        result.at(2).push_back(spline1dcalc(spline_z, si));
-    }
+    // step 04. calculate the spline with density
+    if(result.size() < 3) result.resize(3);
+    sampling(workspace, smin, step, cnt, result, 0, _derivatives);
     return true;
 }
 
 bool AlglibSplineFitting::fitting_normal(
-    const std::vector<double>& xarray, 
-    const std::vector<double>& yarray, 
-    const std::vector<double>& zarray,
+    const double* xarray, 
+    const double* yarray, 
+    const double* zarray,
+    const double* warray,
+    size_t n,
     std::vector<std::vector<double>>& result,
-    double density)
+    double density,
+    FitWorkspace& workspace)
 {
-    // step 01. convert to real_1d_array
-    real_1d_array x, y, z;
-    int n = xarray.size();
-    x.setcontent(n, xarray.data());
-    y.setcontent(n, yarray.data());
-    z.setcontent(n, zarray.data());
-
-    // step 02. begin spline 1d fit
-    spline1dinterpolant spline_y, spline_z;
-    spline1dfitreport rep_y, rep_z;
-    spline1dfit(x, y, _base_function_num, _lambdans, spline_y, rep_y);
-    spline1dfit(x, z, _base_function_num, _lambdans, spline_z, rep_z);
-
-    // step 03. prepare parameters
-    double xmin = *std::min_element(xarray.begin(), xarray.end());
-    double xmax = *std::max_element(xarray.begin(), xarray.end());
+    // step 01. fit y and z with the design matrix of x
+    if(!fit_normal(xarray, yarray, zarray, warray, n, workspace)){
+        return false;
+    }
+    // step 02. prepare parameters
+    double xmin = *std::min_element(xarray, xarray + n);
+    double xmax = *std::max_element(xarray, xarray + n);
     int cnt = (int)((xmax - xmin) / density);
     if(cnt == 0){
         std::cout 
@@ -156,41 +304,92 @@ bool AlglibSplineFitting::fitting_normal(
     }
     double step = (xmax - xmin) / cnt;
 
-    // step 04. calculate the spline with density
-    result.resize(3, std::vector<double>(0.0));
-    result.at(0).reserve(cnt + 1);
-    result.at(1).reserve(cnt + 1);
-    result.at(2).reserve(cnt + 1);
+    // step 03. calculate the spline with density
+    if(result.size() < 3) result.resize(3);
+    result.at(0).reserve(result.at(0).size() + cnt + 1);
     for(int i = 0; i <= cnt; i++){
         double xi = xmin + i * step;
         result.at(0).push_back(xi);
-        result.at(1).push_back(spline1dcalc(spline_y, xi));
-        result.at(2).push_back(spline1dcalc(spline_z, xi));
     }
+    sampling(workspace, xmin, step, cnt, result, 1, _derivatives);
     return true;
 }
 
+bool AlglibSplineFitting::fit_custom_param(
+    const double* xarray, 
+    const double* yarray, 
+    const double* zarray,
+    const double* sarray,
+    const double* warray,
+    size_t n,
+    FitWorkspace& workspace)
+{
+    if(n == 0){
+        std::cout << "ERROR.fitting(): sarray.size() is 0.\n";
+        return false;
+    }
+    workspace.inputs.assign({xarray, yarray, zarray});
+    configure(workspace.solver);
+    return shared_fitting(sarray, n, warray, workspace);
+}
+
+bool AlglibSplineFitting::fit_param(
+    const double* xarray, 
+    const double* yarray, 
+    const double* zarray,
+    const double* warray,
+    size_t n,
+    FitWorkspace& workspace)
+{
+    std::vector<double>& sarray = workspace.sarray;
+    sarray.clear();
+    if(!calculator(xarray, yarray, n, sarray)) {
+        return false;
+    }
+    workspace.inputs.assign({xarray, yarray, zarray});
+    configure(workspace.solver);
+    return shared_fitting(sarray.data(), sarray.size(), warray, workspace);
+}
+
+bool AlglibSplineFitting::fit_normal(
+    const double* xarray, 
+    const double* yarray, 
+    const double* zarray,
+    const double* warray,
+    size_t n,
+    FitWorkspace& workspace)
+{
+    workspace.inputs.assign({yarray, zarray});
+    configure(workspace.solver);
+    return shared_fitting(xarray, n, warray, workspace);
+}
+
+void AlglibSplineFitting::configure(asfit::PenalizedSpline& solver) const
+{
+    solver.lambdans() = _lambdans;
+    solver.base_function_num() = _base_function_num;
+    solver.knot_spacing() = _knot_spacing;
+    solver.max_base_function_num() = _max_base_function_num;
+    solver.gcv_grid() = _gcv_grid;
+    solver.gcv_lambdans_min() = _gcv_lambdans_min;
+    solver.gcv_lambdans_max() = _gcv_lambdans_max;
+    solver.direct() = _direct_solve;
+}
+
 bool AlglibSplineFitting::calculator(
-    const std::vector<double>& x, 
-    const std::vector<double>& y, 
+    const double* x, 
+    const double* y, 
+    size_t n,
     std::vector<double>& s)
 {
-    if(x.size() != y.size() || x.size() <= 1 || y.size() <= 1){
+    if(n <= 1){
         std::cout << "ERROR.calculator(): x.size() or y.size() is unvalid.\n";
         return false;
     }
-    s.reserve(x.size());
+    s.reserve(n);
     s.push_back(0);
-    auto xiter = x.begin();
-    auto yiter = y.begin();
-    for(int i = 0; i < x.size() - 1; i++){
-        double x0 = *xiter;
-        double y0 = *yiter;
-        ++xiter;
-        ++yiter;
-        double x1 = *xiter;
-        double y1 = *yiter;
-        s.push_back(s.back() + length(x0, y0, x1, y1));
+    for(size_t i = 0; i < n - 1; i++){
+        s.push_back(s.back() + length(x[i], y[i], x[i + 1], y[i + 1]));
     }
     if(s.size() <= 0) return false;
     return true;
@@ -3,7 +3,37 @@
 // @Author     : tongjx
 
 #pragma once
+#include <cstddef>
 #include <vector>
+#include "utils/penalized_spline.h"
+#include "utils/piecewise_cubic.h"
+#include "utils/param_spline.h"
+
+/**
+ * FIT WORKSPACE
+ * 
+ * Description:
+ *    buffers of AlglibSplineFitting, a workspace passed to repeated fittings keeps
+ *    its memory, so the fittings of similar size do not allocate after the first one
+ * Parameters:
+ *    @result: [[x], [y], [z]] spline of the last fitting
+ *    @model:  fitted curve of the last fitting with arc_length_sampling(), only built for it
+*/
+struct FitWorkspace
+{
+    std::vector<std::vector<double>> result;
+
+    asfit::PenalizedSpline solver;
+    std::vector<asfit::HermiteSpline> hermites;
+    std::vector<asfit::SplineFitReport> reps;
+    asfit::PiecewiseCubic splines;
+    asfit::ParamSpline3D model;
+    asfit::PiecewiseCubic::Derivatives derivatives;
+    asfit::ParamSpline3D::SampleBuffers sample_buffers;
+    std::vector<const double*> inputs;
+    std::vector<double*> outputs;
+    std::vector<double> sarray;
+};
 
 /** 
  * ALGLIBSPLINE FITTING
@@ -14,6 +44,16 @@
  *    @lambdans: 1e-3 as default, understanding as offset error
  *    @base_function_num: 50 as default, base function number of spline
  *                        this parameter determines the fineness of the curve
+ *    @knot_spacing: 0 as default, the fixed base_function_num is used, otherwise the
+ *                   base function number is chosen from the curve length, see asfit::PenalizedSpline
+ *    @max_base_function_num: 1000 as default, upper limit of the chosen base function number
+ *    @gcv_grid: 0 as default, the fixed lambdans is used, otherwise lambdans is chosen from
+ *               gcv_grid values of [gcv_lambdans_min, gcv_lambdans_max] by generalized cross-validation
+ *    @direct_solve: false as default, solve the banded normal equations directly instead of LSQR
+ *    @arc_length_sampling: false as default, ASF_PARAM and the custom parameter fitting sample the
+ *                          fitted curve at equal arc length instead of equal steps of s
+ *    @derivatives: false as default, the result also gets the first and second derivatives, the heading
+ *                  and the signed curvature of every sample, the rows are asfit::SampleRow
 */
 class AlglibSplineFitting
 {
@@ -31,6 +71,27 @@ public:
     /* Control how much control points for the spline, 
        provides more degrees of shape curvature when the value is larger.*/
     double& base_function_num() {return _base_function_num; }
+    /* Finest knot spacing in meters of the automatic base function number,
+       the fixed base_function_num is used when the value is 0.*/
+    double& knot_spacing() { return _knot_spacing; }
+    /* Upper limit of the automatic base function number.*/
+    double& max_base_function_num() { return _max_base_function_num; }
+    /* Number of lambdans values tried by the generalized cross-validation,
+       the fixed lambdans is used when the value is 0, 20 is a good choice.*/
+    int& gcv_grid() { return _gcv_grid; }
+    /* Log-spaced range of the lambdans values of the generalized cross-validation.*/
+    double& gcv_lambdans_min() { return _gcv_lambdans_min; }
+    double& gcv_lambdans_max() { return _gcv_lambdans_max; }
+    /* Solve the banded normal equations with Cholesky and one refinement step instead of LSQR,
+       faster for large point number, the fitting errors are still reported.*/
+    bool& direct_solve() { return _direct_solve; }
+    /* Sample the fitted curve every density of its own arc length instead of every density of s,
+       the chord length s of noisy points is longer than the smoothed curve, so the spacing of
+       the points is even and fewer points are needed for the same accuracy.*/
+    bool& arc_length_sampling() { return _arc_length_sampling; }
+    /* Append the rows [dx], [dy], [dz], [ddx], [ddy], [ddz], [heading], [curvature] to the result,
+       see asfit::SampleRow, evaluated from the spline coefficients in the same pass as the points.*/
+    bool& derivatives() { return _derivatives; }
 
 public:
     /**
@@ -47,6 +108,8 @@ public:
      *    @result:  [[x], [y], [z]] spline with 3*n dimension
      *    @mode:    ASF_PARAM as default, which spline will be created: ASF_PARAM or ASF_NORMAL
      *    @density: 1.0m as default, generate points every 1.0 meter
+     *    @warray:  empty as default, otherwise n non-negative weights of the points, e.g. the confidence
+     *              from the lidar intensity, the fitting error of a point is multiplied by its weight
      * Return:
      *    ture if fitting successs, otherwise return false
     */
@@ -56,7 +119,8 @@ public:
         const std::vector<double>& zarray,
         std::vector<std::vector<double>>& result,
         ASFMode mode = ASF_PARAM,
-        double density = 1.0
+        double density = 1.0,
+        const std::vector<double>& warray = std::vector<double>()
     );
 
     /**
@@ -73,6 +137,7 @@ public:
      *    @sarray:  prameter function s coordinate
      *    @result:  [[x], [y], [z]] spline with 3*n dimension
      *    @density: 1.0m as default, generate points every 1.0 meter
+     *    @warray:  empty as default, the same as the fitting() above
      * Return:
      *    ture if fitting successs, otherwise return false
     */    
@@ -82,31 +147,175 @@ public:
         const std::vector<double>& zarray,
         const std::vector<double>& sarray,
         std::vector<std::vector<double>>& result,
-        double density = 1.0
+        double density = 1.0,
+        const std::vector<double>& warray = std::vector<double>()
+    );
+
+    /**
+     * FITTING
+     * 
+     * Description: 
+     *    same as the fitting() above with arrays of n values instead of vectors,
+     *    e.g. the columns of an asfit::MappedPointCloud
+     * Parameters:
+     *    @n:       number of points of every array
+     *    @warray:  nullptr as default, otherwise n weights of the points
+    */
+    bool fitting(
+        const double* xarray, 
+        const double* yarray, 
+        const double* zarray,
+        size_t n,
+        std::vector<std::vector<double>>& result,
+        ASFMode mode = ASF_PARAM,
+        double density = 1.0,
+        const double* warray = nullptr
+    );
+    bool fitting(
+        const double* xarray, 
+        const double* yarray, 
+        const double* zarray,
+        const double* sarray,
+        size_t n,
+        std::vector<std::vector<double>>& result,
+        double density = 1.0,
+        const double* warray = nullptr
+    );
+
+    /**
+     * FITTING
+     * 
+     * Description: 
+     *    same as the fitting() above, the spline is written into workspace.result
+     *    and all the buffers come from the workspace
+     * Parameters:
+     *    @workspace: buffers reused between the fittings
+    */
+    bool fitting(
+        const double* xarray, 
+        const double* yarray, 
+        const double* zarray,
+        size_t n,
+        FitWorkspace& workspace,
+        ASFMode mode = ASF_PARAM,
+        double density = 1.0,
+        const double* warray = nullptr
+    );
+    bool fitting(
+        const double* xarray, 
+        const double* yarray, 
+        const double* zarray,
+        const double* sarray,
+        size_t n,
+        FitWorkspace& workspace,
+        double density = 1.0,
+        const double* warray = nullptr
+    );
+
+    /**
+     * FITTING
+     * 
+     * Description: 
+     *    fit the curve without sampling it, the curve keeps the coefficients of the splines
+     *    and is sampled or evaluated later, e.g. at another density
+     * Parameters:
+     *    @spline:  fitted curve x(t), y(t), z(t), t is s, or x for ASF_NORMAL
+    */
+    bool fitting(
+        const double* xarray, 
+        const double* yarray, 
+        const double* zarray,
+        size_t n,
+        asfit::ParamSpline3D& spline,
+        ASFMode mode = ASF_PARAM,
+        const double* warray = nullptr
+    );
+    bool fitting(
+        const double* xarray, 
+        const double* yarray, 
+        const double* zarray,
+        const double* sarray,
+        size_t n,
+        asfit::ParamSpline3D& spline,
+        const double* warray = nullptr
     );
 
 private:
+    // fit the splines into workspace.splines without sampling,
+    // warray is nullptr for an unweighted fitting
+    bool fit_custom_param(
+        const double* xarray, 
+        const double* yarray, 
+        const double* zarray,
+        const double* sarray,
+        const double* warray,
+        size_t n,
+        FitWorkspace& workspace
+    );
+    bool fit_param(
+        const double* xarray, 
+        const double* yarray, 
+        const double* zarray,
+        const double* warray,
+        size_t n,
+        FitWorkspace& workspace
+    );
+    bool fit_normal(
+        const double* xarray, 
+        const double* yarray, 
+        const double* zarray,
+        const double* warray,
+        size_t n,
+        FitWorkspace& workspace
+    );
+    bool fitting_custom_param(
+        const double* xarray, 
+        const double* yarray, 
+        const double* zarray,
+        const double* sarray,
+        const double* warray,
+        size_t n,
+        std::vector<std::vector<double>>& result,
+        double density,
+        FitWorkspace& workspace
+    );
     bool fitting_param(
-        const std::vector<double>& xarray, 
-        const std::vector<double>& yarray, 
-        const std::vector<double>& zarray,
+        const double* xarray, 
+        const double* yarray, 
+        const double* zarray,
+        const double* warray,
+        size_t n,
         std::vector<std::vector<double>>& result,
-        double density
+        double density,
+        FitWorkspace& workspace
     );
     bool fitting_normal(
-        const std::vector<double>& xarray, 
-        const std::vector<double>& yarray, 
-        const std::vector<double>& zarray,
+        const double* xarray, 
+        const double* yarray, 
+        const double* zarray,
+        const double* warray,
+        size_t n,
         std::vector<std::vector<double>>& result,
-        double density
+        double density,
+        FitWorkspace& workspace
     );
+    void configure(asfit::PenalizedSpline& solver) const;
     bool calculator(
-        const std::vector<double>& x, 
-        const std::vector<double>& y, 
+        const double* x, 
+        const double* y, 
+        size_t n,
         std::vector<double>& s
     );
 
 private:
     double _lambdans = 1e-4;
     double _base_function_num = 30;
+    double _knot_spacing = 0.0;
+    double _max_base_function_num = 1000;
+    int _gcv_grid = 0;
+    double _gcv_lambdans_min = 1e-8;
+    double _gcv_lambdans_max = 1e-1;
+    bool _direct_solve = false;
+    bool _arc_length_sampling = false;
+    bool _derivatives = false;
 };
\ No newline at end of file
@@ -0,0 +1,238 @@
+// @Description: Benchmarks of the Fitting Stages and the CHP Pipeline
+// @Time       : 2026/10/20 09:40
+// @Author     : tongjx
+
+#include <cmath>
+#include <random>
+#include <vector>
+#include <numeric>
+
+#include <benchmark/benchmark.h>
+
+#include "alglib_spline_fitting.h"
+#include "chp_spline_fitting.h"
+#include "concavehull/concavehull.hpp"
+#include "utils/geometry.h"
+#include "utils/penalized_spline.h"
+#include "utils/piecewise_cubic.h"
+#include "utils/point_cloud.h"
+
+namespace
+{
+    typedef enum {STRAIGHT, CURVED, U_TURN, NOISY} LaneShape;
+
+    const double LANE_LENGTH = 200.0;
+    const double LANE_WIDTH = 0.2;   // width of a lane marking
+    const double ORIGIN_X = 4.0e5;   // UTM like coordinates
+    const double ORIGIN_Y = 3.0e6;
+
+    /* Point and heading of the lane center line at arc length s. */
+    void center_line(LaneShape shape, double s, double& x, double& y, double& heading)
+    {
+        if(shape == CURVED){
+            const double radius = 300.0;
+            heading = s / radius;
+            x = radius * std::sin(heading);
+            y = radius * (1 - std::cos(heading));
+            return;
+        }
+        if(shape == U_TURN){
+            const double radius = 12.0;
+            const double straight = (LANE_LENGTH - M_PI * radius) / 2;
+            if(s <= straight){
+                x = s; y = 0.0; heading = 0.0;
+            }else if(s <= straight + M_PI * radius){
+                heading = (s - straight) / radius;
+                x = straight + radius * std::sin(heading);
+                y = radius * (1 - std::cos(heading));
+            }else{
+                x = straight - (s - straight - M_PI * radius);
+                y = 2 * radius;
+                heading = M_PI;
+            }
+            return;
+        }
+        x = s; y = 0.0; heading = 0.0;
+    }
+
+    /* Unordered points of a lane marking with n points, the noisy lane has jitter and 1% outliers. */
+    asfit::PointCloud make_lane(LaneShape shape, size_t n, unsigned seed = 1)
+    {
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        std::normal_distribution<double> jitter(0.0, 0.05);
+        asfit::PointCloud cloud;
+        cloud.reserve(n);
+        for(size_t i = 0; i < n; i++){
+            double s = unit(gen) * LANE_LENGTH;
+            double offset = (unit(gen) - 0.5) * LANE_WIDTH;
+            double x, y, heading;
+            center_line(shape, s, x, y, heading);
+            if(shape == NOISY){
+                offset += jitter(gen);
+                if(unit(gen) < 0.01) offset += (unit(gen) - 0.5) * 2.0;
+            }
+            cloud.x.push_back(ORIGIN_X + x - offset * std::sin(heading));
+            cloud.y.push_back(ORIGIN_Y + y + offset * std::cos(heading));
+            cloud.z.push_back(0.02 * s + 0.01 * unit(gen));
+        }
+        return cloud;
+    }
+
+    std::vector<double> interleave(const asfit::PointCloud& cloud)
+    {
+        std::vector<double> coords;
+        coords.reserve(2 * cloud.size());
+        for(size_t i = 0; i < cloud.size(); i++){
+            coords.push_back(cloud.x[i]);
+            coords.push_back(cloud.y[i]);
+        }
+        return coords;
+    }
+
+    /* Ordered samples of the curved center line, cnt points with lateral noise. */
+    void make_line(size_t cnt, double noise, std::vector<double>& s, std::vector<double>& x, std::vector<double>& y)
+    {
+        std::mt19937 gen(7);
+        std::normal_distribution<double> jitter(0.0, noise);
+        s.resize(cnt);
+        x.resize(cnt);
+        y.resize(cnt);
+        for(size_t i = 0; i < cnt; i++){
+            double heading;
+            s[i] = LANE_LENGTH * i / (cnt - 1);
+            center_line(CURVED, s[i], x[i], y[i], heading);
+            x[i] += ORIGIN_X - jitter(gen) * std::sin(heading);
+            y[i] += ORIGIN_Y + jitter(gen) * std::cos(heading);
+        }
+    }
+}
+
+static void BM_ConcaveHull(benchmark::State& state)
+{
+    std::vector<double> coords = interleave(make_lane(CURVED, state.range(0)));
+    for(auto _ : state){
+        benchmark::DoNotOptimize(concavehull(coords, 5e-2));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ConcaveHull)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+
+static void BM_Delaunator(benchmark::State& state)
+{
+    std::vector<double> coords = interleave(make_lane(CURVED, state.range(0)));
+    for(auto _ : state){
+        delaunator::Delaunator d(coords);
+        benchmark::DoNotOptimize(d.triangles.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Delaunator)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+
+static void BM_DouglasPeucker(benchmark::State& state)
+{
+    std::vector<double> s, x, y;
+    make_line(state.range(0), 0.05, s, x, y);
+    asfit::Polyline line;
+    for(size_t i = 0; i < s.size(); i++) line.data.push_back(asfit::Point(x[i], y[i]));
+    std::vector<size_t> kept;
+    for(auto _ : state){
+        line.douglas_peuker(kept, 0.3);
+        benchmark::DoNotOptimize(kept.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DouglasPeucker)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMicrosecond);
+
+static void BM_Projection(benchmark::State& state)
+{
+    // nearest segment of a 200 vertex reference line for every point, as in the CHP projection
+    std::vector<double> s, x, y;
+    make_line(200, 0.0, s, x, y);
+    asfit::PointCloud cloud = make_lane(CURVED, state.range(0));
+    for(auto _ : state){
+        asfit::SegmentGrid grid;
+        grid.build(x, y);
+        int hint = -1;
+        double sum = 0.0;
+        for(size_t i = 0; i < cloud.size(); i++){
+            double dis = 0.0, ds = 0.0;
+            int index = grid.nearest(cloud.point(i), dis, ds, hint);
+            if(index >= 0){
+                sum += s[index] + ds;
+                hint = index;
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Projection)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+
+static void BM_SplineFit(benchmark::State& state)
+{
+    // x, y and z over the same s, the replacement of three spline1dfit calls
+    std::vector<double> s, x, y;
+    make_line(state.range(0), 0.1, s, x, y);
+    std::vector<double> z(s.size());
+    for(size_t i = 0; i < s.size(); i++) z[i] = 0.02 * s[i];
+    asfit::PenalizedSpline solver;
+    std::vector<asfit::HermiteSpline> splines;
+    std::vector<asfit::SplineFitReport> reps;
+    std::vector<const double*> ys = {x.data(), y.data(), z.data()};
+    for(auto _ : state){
+        benchmark::DoNotOptimize(solver.fitting(s.data(), ys, s.size(), splines, reps));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SplineFit)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+
+static void BM_SplineSampling(benchmark::State& state)
+{
+    // samples of the fitted x, y, z splines, the replacement of spline1dcalc
+    std::vector<double> s, x, y;
+    make_line(2000, 0.1, s, x, y);
+    std::vector<const double*> ys = {x.data(), y.data(), y.data()};
+    asfit::PenalizedSpline solver;
+    std::vector<asfit::HermiteSpline> hermites;
+    std::vector<asfit::SplineFitReport> reps;
+    solver.fitting(s.data(), ys, s.size(), hermites, reps);
+    asfit::PiecewiseCubic splines;
+    splines.build(hermites);
+    size_t cnt = state.range(0);
+    std::vector<double> ox(cnt), oy(cnt), oz(cnt);
+    std::vector<double*> out = {ox.data(), oy.data(), oz.data()};
+    for(auto _ : state){
+        splines.calc(0.0, LANE_LENGTH / cnt, cnt, out);
+        benchmark::DoNotOptimize(ox.data());
+    }
+    state.SetItemsProcessed(state.iterations() * cnt);
+}
+BENCHMARK(BM_SplineSampling)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMicrosecond);
+
+static void BM_ChpFitting(benchmark::State& state)
+{
+    LaneShape shape = LaneShape(state.range(0));
+    asfit::PointCloud cloud = make_lane(shape, state.range(1));
+    ConcaveHullParamSplineFitting fitting;
+    std::vector<std::vector<double>> result;
+    FitStats stats;
+    for(auto _ : state){
+        result.clear();
+        if(!fitting.fitting(cloud.x, cloud.y, cloud.z, result, stats)){
+            state.SkipWithError("chp fitting failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+    state.counters["hull_ms"] = stats.stage_ms[FitStats::CONCAVE_HULL];
+    state.counters["projection_ms"] = stats.stage_ms[FitStats::PROJECTION];
+    state.counters["fit_ms"] = stats.stage_ms[FitStats::FIT];
+    state.counters["rms_y"] = stats.rmserror[1];
+}
+BENCHMARK(BM_ChpFitting)
+    ->ArgNames({"shape", "points"})
+    ->ArgsProduct({{STRAIGHT, CURVED, U_TURN, NOISY}, {1000, 10000, 100000, 1000000, 10000000}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -1,6 +1,7 @@
 #include "chp_spline_fitting.h"
 #include "alglib_spline_fitting.h"
 #include "concavehull/concavehull.hpp"
+#include "utils/thread_pool.h"
 
 #include <iostream>
 #include <list>
@@ -8,15 +9,13 @@
 #include <unordered_set>
 #include <unordered_map>
 #include <fstream>
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+#include <utility>
 
-/* Less Function */
-struct PointLess
-{
-    bool operator()(const asfit::Point &a, const asfit::Point &b) const
-    {
-        return a.attributes.at("s") < b.attributes.at("s");
-    }
-};
+// points of a fitting to project on several threads
+const size_t PARALLEL_PROJECTION_POINTS = 1 << 16;
 
 /* Split ordered vector with tolerance. */
 std::list<std::tuple<size_t, size_t>> split_vector_with_order_tolerance(
@@ -52,57 +51,237 @@ bool ConcaveHullParamSplineFitting::fitting(
     const std::vector<double>& yarray, 
     const std::vector<double>& zarray,
     std::vector<std::vector<double>>& result,
-    double density)
+    double density,
+    const std::vector<double>& warray)
+{
+    if(xarray.size() != yarray.size() || yarray.size() != zarray.size()
+        || (!warray.empty() && warray.size() != xarray.size())){
+        std::cout << "ERROR.chp_spline_fitting.cpp::fitting(): pcl array size is invalid.\n";
+        return false;
+    }
+    Workspace workspace;
+    const double* weights = warray.empty() ? nullptr : warray.data();
+    return fitting(xarray.data(), yarray.data(), zarray.data(), weights, xarray.size(), result, density, workspace);
+}
+
+bool ConcaveHullParamSplineFitting::fitting(
+    const double* xarray, 
+    const double* yarray, 
+    const double* zarray,
+    size_t n,
+    std::vector<std::vector<double>>& result,
+    double density,
+    const double* warray)
+{
+    Workspace workspace;
+    return fitting(xarray, yarray, zarray, warray, n, result, density, workspace);
+}
+
+bool ConcaveHullParamSplineFitting::fitting(
+    const std::vector<double>& xarray, 
+    const std::vector<double>& yarray, 
+    const std::vector<double>& zarray,
+    std::vector<std::vector<double>>& result,
+    FitStats& stats,
+    double density,
+    const std::vector<double>& warray)
+{
+    if(xarray.size() != yarray.size() || yarray.size() != zarray.size()
+        || (!warray.empty() && warray.size() != xarray.size())){
+        std::cout << "ERROR.chp_spline_fitting.cpp::fitting(): pcl array size is invalid.\n";
+        stats = FitStats();
+        stats.failed_stage = FitStats::PREPARE;
+        return false;
+    }
+    const double* weights = warray.empty() ? nullptr : warray.data();
+    return fitting(xarray.data(), yarray.data(), zarray.data(), xarray.size(), result, stats, density, weights);
+}
+
+bool ConcaveHullParamSplineFitting::fitting(
+    const double* xarray, 
+    const double* yarray, 
+    const double* zarray,
+    size_t n,
+    std::vector<std::vector<double>>& result,
+    FitStats& stats,
+    double density,
+    const double* warray)
+{
+    Workspace workspace;
+    bool success = fitting(xarray, yarray, zarray, warray, n, result, density, workspace);
+    stats = workspace.stats;
+    return success;
+}
+
+bool ConcaveHullParamSplineFitting::fitting(
+    const double* xarray, 
+    const double* yarray, 
+    const double* zarray,
+    size_t n,
+    std::vector<std::vector<double>>& result,
+    asfit::ParamSpline3D& spline,
+    double density,
+    const double* warray)
+{
+    Workspace workspace;
+    if(!fitting(xarray, yarray, zarray, warray, n, result, density, workspace)) return false;
+    return spline.build(workspace.fit.splines);
+}
+
+size_t ConcaveHullParamSplineFitting::fit_batch(
+    const asfit::PointCloud* clusters,
+    size_t cnt,
+    std::vector<std::vector<std::vector<double>>>& results,
+    double density,
+    const std::string& weights)
+{
+    results.assign(cnt, std::vector<std::vector<double>>());
+    if(cnt == 0) return 0;
+    asfit::ThreadPool pool(std::min(_workers != 0 ? _workers : size_t(std::thread::hardware_concurrency()), cnt));
+    std::vector<Workspace> workspaces(pool.workers());
+    for(auto& workspace : workspaces) workspace.parallel = false;
+    std::vector<char> success(cnt, 0);
+    pool.run(cnt, [&](size_t index, size_t worker){
+        const asfit::PointCloud& cluster = clusters[index];
+        std::vector<std::vector<double>>& result = results[index];
+        const std::vector<double>* channel = !weights.empty() && cluster.has_channel(weights) ? &cluster.channel(weights) : nullptr;
+        if(cluster.y.size() != cluster.size() || cluster.z.size() != cluster.size()
+            || (channel != nullptr && channel->size() != cluster.size())){
+            std::cout << "ERROR.chp_spline_fitting.cpp::fit_batch(): pcl array size is invalid.\n";
+        }else{
+            const double* warray = channel != nullptr ? channel->data() : nullptr;
+            success[index] = fitting(
+                cluster.x.data(), cluster.y.data(), cluster.z.data(), warray, cluster.size(), result, density, workspaces[worker]);
+        }
+        if(!success[index]) std::vector<std::vector<double>>().swap(result);
+    });
+    return std::count(success.begin(), success.end(), 1);
+}
+
+bool ConcaveHullParamSplineFitting::fitting(
+    const double* xarray, 
+    const double* yarray, 
+    const double* zarray,
+    const double* warray,
+    size_t n,
+    std::vector<std::vector<double>>& result,
+    double density,
+    Workspace& workspace)
+{
+    FitStats& stats = workspace.stats;
+    stats = FitStats();
+    stats.points = n;
+    auto start = std::chrono::steady_clock::now();
+    stats.success = fitting_stages(xarray, yarray, zarray, warray, n, result, density, workspace);
+    stats.total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if(_stats_callback) _stats_callback(stats);
+    return stats.success;
+}
+
+bool ConcaveHullParamSplineFitting::fitting_stages(
+    const double* xarray, 
+    const double* yarray, 
+    const double* zarray,
+    const double* warray,
+    size_t n,
+    std::vector<std::vector<double>>& result,
+    double density,
+    Workspace& workspace)
 {
+    // wall time of the stage since the previous lap
+    FitStats& stats = workspace.stats;
+    auto clock = std::chrono::steady_clock::now();
+    auto lap = [&stats, &clock](FitStats::Stage stage){
+        auto now = std::chrono::steady_clock::now();
+        stats.stage_ms[stage] = std::chrono::duration<double, std::milli>(now - clock).count();
+        clock = now;
+    };
+
     // step 00. check value
-    if(xarray.size() != yarray.size() || yarray.size() != zarray.size() || xarray.size() < 2){
+    stats.failed_stage = FitStats::PREPARE;
+    if(n < 2){
         std::cout << "ERROR.chp_spline_fitting.cpp::fitting(): pcl array size is invalid.\n";
         return false;
     }
 
-    std::vector<double> pointsets;
-    std::vector<asfit::Point> concave_geom;
-    std::vector<asfit::Point> pcl_points, projected_pcl_points;
-    asfit::Polyline reference_line;
+    std::vector<double>& pointsets = workspace.pointsets;
+    asfit::PointCloud& concave_geom = workspace.concave_geom;
+    asfit::PointCloud& pcl_points = workspace.pcl_points;
+    asfit::PointCloud& projected_pcl_points = workspace.projected_pcl_points;
+    asfit::PointCloud& reference_line = workspace.reference_line;
+    pointsets.clear();
+    concave_geom.clear();
+    reference_line.clear();
 
     // step 01. prepare the data
-    pcl_points.reserve(xarray.size());
-    pointsets.reserve(xarray.size() * 2);
-    for(int i = 0; i < xarray.size(); i++){
-        pointsets.push_back(xarray.at(i));
-        pointsets.push_back(yarray.at(i));
-        asfit::Point pt(xarray.at(i), yarray.at(i));
-        pt.attributes["z"] = zarray.at(i);
-        pcl_points.push_back(pt);
+    pcl_points.x.assign(xarray, xarray + n);
+    pcl_points.y.assign(yarray, yarray + n);
+    pcl_points.z.assign(zarray, zarray + n);
+    pointsets.reserve(n * 2);
+    for(size_t i = 0; i < n; i++){
+        pointsets.push_back(xarray[i]);
+        pointsets.push_back(yarray[i]);
     }
+    lap(FitStats::PREPARE);
 
     // step 02. generate concave hull geometry
+    stats.failed_stage = FitStats::CONCAVE_HULL;
     if(!generate_concave_hull(pointsets, concave_geom)){
         return false;
     }
+    stats.hull_points = concave_geom.size();
+    lap(FitStats::CONCAVE_HULL);
 
     // step 03. generate reference line by concave hull geometry
+    stats.failed_stage = FitStats::REFERENCE_LINE;
     if(!generate_reference_line_with_concave_hull(concave_geom, reference_line)){
         return false;
     }
+    stats.reference_line_points = reference_line.size();
+    lap(FitStats::REFERENCE_LINE);
 
     // step 04. projecting points onto the reference line
-    if(!projection(reference_line, pcl_points, projected_pcl_points)){
+    stats.failed_stage = FitStats::PROJECTION;
+    if(!projection(reference_line, pcl_points, projected_pcl_points, workspace)){
         return false;
     }
+    // the weights follow the points into the order of s
+    const double* weights = nullptr;
+    if(warray != nullptr){
+        const std::vector<size_t>& order = workspace.order;
+        workspace.warray.resize(n);
+        for(size_t i = 0; i < n; i++) workspace.warray[i] = warray[order[i]];
+        weights = workspace.warray.data();
+    }
+    stats.segments = reference_line.size() - 1;
+    lap(FitStats::PROJECTION);
 
     // step 05. fitting the pcl points
-    if(!fitting_pcl_points(projected_pcl_points, result, density)){
+    stats.failed_stage = FitStats::FIT;
+    if(!fitting_pcl_points(projected_pcl_points, weights, result, density, workspace.fit)){
         return false;
     }
+    const std::vector<asfit::SplineFitReport>& reps = workspace.fit.reps;
+    if(!reps.empty()){
+        stats.base_function_num = reps[0].base_function_num;
+        stats.lambdans = reps[0].lambdans;
+    }
+    for(size_t k = 0; k < 3 && k < reps.size(); k++){
+        stats.lsqr_iterations[k] = reps[k].iterations;
+        stats.rmserror[k] = reps[k].rmserror;
+        stats.maxerror[k] = reps[k].maxerror;
+    }
+    stats.samples = workspace.fit.result.at(0).size();
+    lap(FitStats::FIT);
 
     // success
+    stats.failed_stage = -1;
     return true;
 }
 
 bool ConcaveHullParamSplineFitting::generate_concave_hull(
     const std::vector<double>& pcl_points, 
-    std::vector<asfit::Point>& concave_geom)
+    asfit::PointCloud& concave_geom)
 {
     std::vector<double> res = concavehull(pcl_points, _concave_lambdans);
     if(res.size() < 3){
@@ -112,17 +291,15 @@ bool ConcaveHullParamSplineFitting::generate_concave_hull(
     concave_geom.reserve(int(res.size() / 2));
     for(int i = 0; i < res.size(); i += 2)
     {
-        asfit::Point pt;
-        pt.x = res.at(i);
-        pt.y = res.at(i + 1);
-        concave_geom.push_back(pt);
+        concave_geom.x.push_back(res.at(i));
+        concave_geom.y.push_back(res.at(i + 1));
     }
     return true;
 }
 
 bool ConcaveHullParamSplineFitting::generate_reference_line_with_concave_hull(
-    std::vector<asfit::Point>& concave_geom, 
-    asfit::Polyline& reference_line)
+    asfit::PointCloud& concave_geom, 
+    asfit::PointCloud& reference_line)
 {
     // radius to angle
     auto rad2angle = [](const double& rad){
@@ -130,62 +307,66 @@ bool ConcaveHullParamSplineFitting::generate_reference_line_with_concave_hull(
     };
 
     // calculate the angle for all point
-    asfit::Point& second_to_last_pt = concave_geom.at(concave_geom.size() - 2);
+    std::vector<double>& angles = concave_geom.channel("angle");
+    asfit::Point second_to_last_pt = concave_geom.point(concave_geom.size() - 2);
     for(size_t i = 0; i < concave_geom.size() - 1; i++){
         if(i == 0){
-            asfit::Point& p0 = second_to_last_pt;
-            asfit::Point& p1 = concave_geom.at(i);
-            asfit::Point& p2 = concave_geom.at(i + 1);
-            p1.attributes["angle"] = rad2angle(p1.convex(p0, p2));
+            asfit::Point p0 = second_to_last_pt;
+            asfit::Point p1 = concave_geom.point(i);
+            asfit::Point p2 = concave_geom.point(i + 1);
+            angles.at(i) = rad2angle(p1.convex(p0, p2));
         }
         else{
-            asfit::Point& p0 = concave_geom.at(i - 1);
-            asfit::Point& p1 = concave_geom.at(i);
-            asfit::Point& p2 = concave_geom.at(i + 1);
-            p1.attributes["angle"] = rad2angle(p1.convex(p0, p2));
+            asfit::Point p0 = concave_geom.point(i - 1);
+            asfit::Point p1 = concave_geom.point(i);
+            asfit::Point p2 = concave_geom.point(i + 1);
+            angles.at(i) = rad2angle(p1.convex(p0, p2));
         }
     }
 
-    // summing the convex angle with slidding window
-    concave_geom.pop_back(); 
+    // summing the convex angle with slidding window,
+    // the angles are repeated after the last vertex so the window never wraps,
+    // |fmod(delta, 360)| is |delta| below 360 and the exact |delta| - 360 below 720,
+    // and a window stops once max_delta >= 360 which no folded sum exceeds
+    concave_geom.resize(concave_geom.size() - 1);
     size_t sws = size_t(concave_geom.size() * 0.2);
     sws = sws > 10 ? sws : 10;
     sws = sws < 100 ? sws : 100;
     size_t n = concave_geom.size();
-    for(size_t i = 0; i < concave_geom.size(); i++){
+    std::vector<double> wrapped(n + sws);
+    for(size_t i = 0; i < wrapped.size(); i++) wrapped[i] = angles[i % n];
+    std::vector<double>& max_deltas = concave_geom.channel("max_delta");
+    for(size_t i = 0; i < n; i++){
+        const double* window = wrapped.data() + i;
         double delta = 0.0;
         double max_delta = std::numeric_limits<double>::min();
-        asfit::Point& pt = concave_geom.at(i);
-        for(int j = 1; j < sws; j++){
-            delta += concave_geom.at((i + j) % n).attributes["angle"];
-            if(std::fabs(std::fmod(delta, 360)) > max_delta){
-                max_delta = delta;
-            }
+        for(size_t j = 1; j < sws; j++){
+            delta += window[j];
+            double folded = std::fabs(delta);
+            folded = folded < 360 ? folded : (folded < 720 ? folded - 360 : std::fmod(folded, 360));
+            max_delta = folded > max_delta ? delta : max_delta;
+            if(max_delta >= 360) break;
         }
-        pt.attributes["max_delta"] = std::fabs(std::fmod(max_delta, 360));
+        max_deltas[i] = std::fabs(std::fmod(max_delta, 360));
     }
 
     // std::ofstream opt_file("debug-concave.txt");
     // if(opt_file.is_open()){
-    //     for(auto& pt : concave_geom){
+    //     for(size_t i = 0; i < concave_geom.size(); i++){
     //         opt_file << 
-    //         std::to_string(pt.x) << " " << std::to_string(pt.y) << " "
-    //         << std::to_string(pt.attributes["angle"]) << " "
-    //         << std::to_string(pt.attributes["max_delta"]) 
+    //         std::to_string(concave_geom.x[i]) << " " << std::to_string(concave_geom.y[i]) << " "
+    //         << std::to_string(angles[i]) << " "
+    //         << std::to_string(max_deltas[i]) 
     //         << std::endl;
     //     }
     // }
 
     // process the SW group
-    size_t index = 0;
-    std::unordered_map<size_t, asfit::Point*> sws_pt_map; 
     std::vector<size_t> sws_indices;
-    for(auto& pt : concave_geom){
-        if(pt.attributes["max_delta"] > 160){
+    for(size_t index = 0; index < concave_geom.size(); index++){
+        if(max_deltas[index] > 160){
             sws_indices.push_back(index);
-            sws_pt_map.insert({index, &pt});
         }
-        ++index;
     }
 
     // get sliding window group
@@ -199,7 +380,7 @@ bool ConcaveHullParamSplineFitting::generate_reference_line_with_concave_hull(
     }
 
     // get the represent window
-    std::unordered_map<size_t, asfit::Point*> polar_points;
+    std::unordered_map<size_t, asfit::Point> polar_points;
     for(auto& item : sw_group){
         size_t mid_id = std::floor(0.5 * (std::get<0>(item) + std::get<1>(item)));
         size_t index = sws_indices.at(mid_id);
@@ -207,7 +388,7 @@ bool ConcaveHullParamSplineFitting::generate_reference_line_with_concave_hull(
         long long target_id = -1;
         for(size_t i = index + 1; i < index + sws; i++){
             size_t id = i % n;
-            double angle = std::fabs(concave_geom.at(id).attributes["angle"]);
+            double angle = std::fabs(angles[id]);
             if(angle > 100){
                 if(max_angle < angle){
                     max_angle = angle;
@@ -218,7 +399,7 @@ bool ConcaveHullParamSplineFitting::generate_reference_line_with_concave_hull(
         if(target_id < 0){
             target_id = size_t(index + std::ceil(sws * 0.5)) % n;
         }
-        polar_points.insert({target_id, &concave_geom.at(target_id)});
+        polar_points.insert({target_id, concave_geom.point(target_id)});
     }
     if(polar_points.size() < 2){
         std::cout << "ERROR.ConcaveHullParamSplineFitting::generate_reference_line_with_concave_hull: "
@@ -241,9 +422,9 @@ bool ConcaveHullParamSplineFitting::generate_reference_line_with_concave_hull(
         for(size_t j = i + 1; j < polar_points_keys.size(); j++){
             size_t& ii = polar_points_keys.at(i);
             size_t& jj = polar_points_keys.at(j);
-            asfit::Point* pt0 = polar_points.at(polar_points_keys.at(i));
-            asfit::Point* pt1 = polar_points.at(polar_points_keys.at(j));
-            double len = pt0->get_length_to_pt(*pt1);
+            const asfit::Point& pt0 = polar_points.at(polar_points_keys.at(i));
+            const asfit::Point& pt1 = polar_points.at(polar_points_keys.at(j));
+            double len = pt0.get_length_to_pt(pt1);
             if(len > max_distance){
                 max_distance = len;
             }
@@ -284,68 +465,79 @@ bool ConcaveHullParamSplineFitting::generate_reference_line_with_concave_hull(
     size_t id_0 = std::get<0>(link);
     size_t id_1 = std::get<1>(link);
     if(id_0 > id_1) std::swap(id_0, id_1);
+    const double* hull_x = concave_geom.x.data() + id_0;
+    const double* hull_y = concave_geom.y.data() + id_0;
+    size_t hull_n = id_1 - id_0 + 1;
+
+    // simplify the hull in place, only the kept indices are returned
+    std::vector<size_t> kept;
+    asfit::DouglasPeucker simplifier;
+    simplifier.simplify(hull_x, hull_y, hull_n, kept, 0.3);
+
+    // arc length along the whole hull, the removed vertices still count
     double s = 0.0;
-    reference_line.data.reserve(id_1 - id_0 + 1);
-    for(size_t i = id_0; i <= id_1; i++){
-        asfit::Point pt = concave_geom.at(i);
-        if(reference_line.data.size() != 0){
-            asfit::Point& pt_0 = reference_line.data.back();
-            double ds = pt.get_length_to_pt(pt_0);
-            s += ds;
-            pt.attributes["s"] = s;
-        }else{
-            pt.attributes["s"] = 0.0;
+    size_t next = 0;
+    reference_line.reserve(kept.size());
+    for(size_t i = 0; i < hull_n && next < kept.size(); i++){
+        if(i != 0){
+            double dx = hull_x[i - 1] - hull_x[i], dy = hull_y[i - 1] - hull_y[i];
+            s += std::sqrt(dx * dx + dy * dy);
         }
-        reference_line.data.push_back(pt);
+        if(kept[next] != i) continue;
+        reference_line.x.push_back(hull_x[i]);
+        reference_line.y.push_back(hull_y[i]);
+        reference_line.s.push_back(s);
+        ++next;
     }
 
-    // std::ofstream opt_file("debug-reference-line.txt");
-    // if(opt_file.is_open()){
-    //     std::vector<asfit::Point> out;
-    //     reference_line.douglas_peuker(out, 0.3);
-    //     for(auto& pt : out){
-    //         opt_file << 
-    //         std::to_string(pt.x) << " " << std::to_string(pt.y) << " "
-    //         << std::to_string(pt.attributes["max_delta"])
-    //         << std::endl;
-    //     }
-    // }
-
-    std::vector<asfit::Point> out;
-    reference_line.douglas_peuker(out, 0.3);
-    reference_line.data.swap(out);
-
-    if(reference_line.data.size() < 2){
+    if(reference_line.size() < 2){
         std::cout << "ERROR.chp_spline_fitting.cpp::generate_reference_line_with_concave_hull(): reference line size < 2.\n";
         return false;
     } else{ return true; }
 }
 
 bool ConcaveHullParamSplineFitting::projection(
-    const asfit::Polyline& reference_line, 
-    const std::vector<asfit::Point>& pcl_points, 
-    std::vector<asfit::Point>& result)
+    const asfit::PointCloud& reference_line, 
+    const asfit::PointCloud& pcl_points, 
+    asfit::PointCloud& result,
+    Workspace& workspace)
 {
-    result.reserve(pcl_points.size());
-    for(auto& pt : pcl_points){
-        double s = 0.0;
-        double min_dis = std::numeric_limits<double>::max();
-        for(int i = 1; i < reference_line.data.size(); i++){
-            const asfit::Point& pt0 = reference_line.data.at(i - 1);
-            const asfit::Point& pt1 = reference_line.data.at(i);
-            double s_pt0 = pt0.attributes.at("s");
-            double ds = 0.0;
-            double dis = pt.get_length_to_segment(pt0, pt1, ds);
-            if(dis < min_dis){
-                s = s_pt0 + ds;
-                min_dis = dis;
+    // large clouds are projected and sorted on a pool, unless running on a fit_batch() worker
+    size_t n = pcl_points.size();
+    std::unique_ptr<asfit::ThreadPool> pool;
+    if(workspace.parallel && n >= PARALLEL_PROJECTION_POINTS){
+        size_t workers = _workers != 0 ? _workers : size_t(std::thread::hardware_concurrency());
+        workers = std::min(workers, n / (PARALLEL_PROJECTION_POINTS / 4));
+        if(workers > 1) pool.reset(new asfit::ThreadPool(workers));
+    }
+
+    // nearest segment by grid index, the previous hit seeds the search of the next point of a chunk
+    asfit::SegmentGrid grid;
+    grid.build(reference_line.x, reference_line.y);
+    std::vector<double>& sarray = workspace.sarray;
+    sarray.assign(n, 0.0);
+    auto project = [&](size_t begin, size_t end){
+        int hint = -1;
+        for(size_t i = begin; i < end; i++){
+            double dis = 0.0, ds = 0.0;
+            int index = grid.nearest(pcl_points.point(i), dis, ds, hint);
+            if(index >= 0){
+                sarray[i] = reference_line.s.at(index) + ds;
+                hint = index;
             }
         }
-        asfit::Point pcl_pt = pt;
-        pcl_pt.attributes["s"] = s;
-        result.push_back(pcl_pt);
-    }
-    std::sort(result.begin(), result.end(), PointLess());
+    };
+    if(pool){
+        size_t chunks = 4 * pool->workers();
+        pool->run(chunks, [&](size_t c, size_t){ project(n * c / chunks, n * (c + 1) / chunks); });
+    }else project(0, n);
+
+    // order the points by (s, index) and gather them once
+    std::vector<size_t>& order = workspace.order;
+    workspace.sorter.sort(sarray.data(), n, order, pool.get());
+    pcl_points.gather(order, result);
+    result.s.resize(n);
+    for(size_t i = 0; i < n; i++) result.s[i] = sarray[order[i]];
     if(result.size() != pcl_points.size()){
         std::cout << "ERROR.chp_spline_fitting.cpp::projection(): failed.\n";
         return false;
@@ -355,27 +547,32 @@ bool ConcaveHullParamSplineFitting::projection(
 
 
 bool ConcaveHullParamSplineFitting::fitting_pcl_points(
-    std::vector<asfit::Point>& projected_pcl_points,
+    asfit::PointCloud& projected_pcl_points,
+    const double* warray,
     std::vector<std::vector<double>>& result,
-    const double& density)
+    const double& density,
+    FitWorkspace& workspace)
 {
-    std::vector<double> xarray, yarray, zarray, sarray;
-    xarray.reserve(projected_pcl_points.size());
-    yarray.reserve(projected_pcl_points.size());
-    zarray.reserve(projected_pcl_points.size());
-    sarray.reserve(projected_pcl_points.size());
-    for(auto& pt : projected_pcl_points){
-        xarray.push_back(pt.x);
-        yarray.push_back(pt.y);
-        zarray.push_back(pt.attributes.at("z"));
-        sarray.push_back(pt.attributes.at("s"));
-    }
-
     AlglibSplineFitting splinefitting;
     splinefitting.lambdans() = _lambdans;
     splinefitting.base_function_num() = _base_function_num;
-    if (!splinefitting.fitting(xarray, yarray, zarray, sarray, result, density)){
+    splinefitting.knot_spacing() = _knot_spacing;
+    splinefitting.max_base_function_num() = _max_base_function_num;
+    splinefitting.gcv_grid() = _gcv_grid;
+    splinefitting.gcv_lambdans_min() = _gcv_lambdans_min;
+    splinefitting.gcv_lambdans_max() = _gcv_lambdans_max;
+    splinefitting.direct_solve() = _direct_solve;
+    splinefitting.arc_length_sampling() = _arc_length_sampling;
+    splinefitting.derivatives() = _derivatives;
+    if (!splinefitting.fitting(
+            projected_pcl_points.x.data(), projected_pcl_points.y.data(), projected_pcl_points.z.data(), 
+            projected_pcl_points.s.data(), projected_pcl_points.size(), workspace, density, warray)){
         std::cout << "ERROR.AlglibSplineFitting(): alglib spline fitting failed.\n";
         return false;
-    }else { return true; }
+    }
+    result.resize(std::max(result.size(), workspace.result.size()), std::vector<double>(0.0));
+    for(size_t k = 0; k < workspace.result.size(); k++){
+        result[k].insert(result[k].end(), workspace.result[k].begin(), workspace.result[k].end());
+    }
+    return true;
 }
\ No newline at end of file
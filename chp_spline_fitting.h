@@ -4,8 +4,40 @@
 
 #pragma once
 
+#include <string>
 #include <vector>
+#include <functional>
 #include "utils/geometry.h"
+#include "utils/point_cloud.h"
+#include "utils/radix_sort.h"
+#include "alglib_spline_fitting.h"
+
+/**
+ * FIT STATS
+ * 
+ * Description:
+ *    wall time and counters of the stages of one ConcaveHullParamSplineFitting fitting,
+ *    the values of the stages after a failed one stay zero
+*/
+struct FitStats
+{
+    typedef enum {PREPARE, CONCAVE_HULL, REFERENCE_LINE, PROJECTION, FIT, STAGE_NUM} Stage;
+
+    bool success = false;
+    int failed_stage = -1;                  // Stage which failed, -1 if success
+    double stage_ms[STAGE_NUM] = {0.0};     // wall time of every Stage in milliseconds
+    double total_ms = 0.0;
+    size_t points = 0;                      // input points
+    size_t hull_points = 0;                 // concave hull vertices
+    size_t reference_line_points = 0;       // reference line vertices after simplification
+    size_t segments = 0;                    // reference line segments the points are projected on
+    size_t samples = 0;                     // points of the output spline
+    int base_function_num = 0;              // base function number of the fitted spline
+    double lambdans = 0.0;                  // nonlinearity penalty of the fitted spline
+    int lsqr_iterations[3] = {0, 0, 0};     // x, y, z
+    double rmserror[3] = {0.0, 0.0, 0.0};   // x, y, z
+    double maxerror[3] = {0.0, 0.0, 0.0};   // x, y, z
+};
 
 class ConcaveHullParamSplineFitting
 {
@@ -20,10 +52,32 @@ public:
     /* Control how much control points for the spline, 
        provides more degrees of shape curvature when the value is larger.*/
     double& base_function_num() {return _base_function_num; }
+    /* Finest knot spacing in meters of the automatic base function number,
+       the fixed base_function_num is used when the value is 0.*/
+    double& knot_spacing() { return _knot_spacing; }
+    /* Upper limit of the automatic base function number.*/
+    double& max_base_function_num() { return _max_base_function_num; }
+    /* Number of lambdans values tried by the generalized cross-validation,
+       the fixed lambdans is used when the value is 0.*/
+    int& gcv_grid() { return _gcv_grid; }
+    double& gcv_lambdans_min() { return _gcv_lambdans_min; }
+    double& gcv_lambdans_max() { return _gcv_lambdans_max; }
+    /* Solve the banded normal equations directly instead of LSQR.*/
+    bool& direct_solve() { return _direct_solve; }
+    /* Sample the fitted curve at equal arc length instead of equal steps of s.*/
+    bool& arc_length_sampling() { return _arc_length_sampling; }
+    /* Append the derivatives, the heading and the curvature rows of asfit::SampleRow to the result.*/
+    bool& derivatives() { return _derivatives; }
     /* Control the concave shape, 
        the shape is roupher when the value is larger.*/
     double& concave_lambdans(){ return _concave_lambdans; }
-    
+    /* Control how much threads fit_batch() runs on,
+       all the hardware threads are used when the value is 0.*/
+    size_t& workers(){ return _workers; }
+    /* Called with the stats after every fitting, also for the clusters of fit_batch(),
+       where it runs on the worker threads concurrently.*/
+    std::function<void(const FitStats&)>& stats_callback(){ return _stats_callback; }
+
 public:
     /**
      * FITTING
@@ -39,6 +93,9 @@ public:
      *    @result:  [[x], [y], [z]] spline with 3*n dimension
      *    @mode:    ASF_PARAM as default, which spline will be created: ASF_PARAM or ASF_NORMAL
      *    @density: 1.0m as default, generate points every 1.0 meter
+     *    @warray:  empty as default, otherwise n non-negative weights of the points, e.g. the confidence
+     *              from the lidar intensity, they follow the points through the projection and the
+     *              fitting error of a point is multiplied by its weight
      * Return:
      *    ture if fitting successs, otherwise return false
     */
@@ -47,17 +104,168 @@ public:
         const std::vector<double>& yarray, 
         const std::vector<double>& zarray,
         std::vector<std::vector<double>>& result,
-        double density = 1.0
+        double density = 1.0,
+        const std::vector<double>& warray = std::vector<double>()
+    );
+
+    /**
+     * FITTING
+     * 
+     * Description: 
+     *    same as the fitting() above with arrays of n values instead of vectors,
+     *    e.g. the columns of an asfit::MappedPointCloud
+     * Parameters:
+     *    @n:       number of points of every array
+     *    @warray:  nullptr as default, otherwise n weights of the points
+    */
+    bool fitting(
+        const double* xarray, 
+        const double* yarray, 
+        const double* zarray,
+        size_t n,
+        std::vector<std::vector<double>>& result,
+        double density = 1.0,
+        const double* warray = nullptr
+    );
+
+    /**
+     * FITTING
+     * 
+     * Description: 
+     *    same as the fitting() above, and report the time and counters of the stages
+     * Parameters:
+     *    @stats:   time and counters of the stages
+    */
+    bool fitting(
+        const std::vector<double>& xarray, 
+        const std::vector<double>& yarray, 
+        const std::vector<double>& zarray,
+        std::vector<std::vector<double>>& result,
+        FitStats& stats,
+        double density = 1.0,
+        const std::vector<double>& warray = std::vector<double>()
+    );
+    bool fitting(
+        const double* xarray, 
+        const double* yarray, 
+        const double* zarray,
+        size_t n,
+        std::vector<std::vector<double>>& result,
+        FitStats& stats,
+        double density = 1.0,
+        const double* warray = nullptr
+    );
+
+    /**
+     * FITTING
+     * 
+     * Description: 
+     *    same as the fitting() above, and keep the fitted curve, which can be sampled
+     *    again at any density or evaluated without refitting
+     * Parameters:
+     *    @spline:  fitted curve x(s), y(s), z(s) over the arc length s of the reference line
+    */
+    bool fitting(
+        const double* xarray, 
+        const double* yarray, 
+        const double* zarray,
+        size_t n,
+        std::vector<std::vector<double>>& result,
+        asfit::ParamSpline3D& spline,
+        double density = 1.0,
+        const double* warray = nullptr
+    );
+
+    /**
+     * FIT BATCH
+     * 
+     * Description: 
+     *    fit independent point clusters in parallel on workers() threads, 
+     *    every cluster is fitted the same as fitting() with its x, y and z arrays
+     * Parameters:
+     *    @clusters: first cluster of the batch
+     *    @cnt:      number of clusters
+     *    @results:  [[x], [y], [z]] spline of every cluster in input order, 
+     *               empty if the fitting of the cluster failed
+     *    @density:  1.0m as default, generate points every 1.0 meter
+     *    @weights:  empty as default, otherwise the name of the channel with the weights of the points,
+     *               e.g. "intensity", the clusters without the channel are fitted unweighted
+     * Return:
+     *    number of clusters fitted successfully
+    */
+    size_t fit_batch(
+        const asfit::PointCloud* clusters,
+        size_t cnt,
+        std::vector<std::vector<std::vector<double>>>& results,
+        double density = 1.0,
+        const std::string& weights = std::string()
     );
 
 private:
-    bool generate_concave_hull(const std::vector<double>& pcl_points, std::vector<asfit::Point>& concave_geom);
-    bool generate_reference_line_with_concave_hull(std::vector<asfit::Point>& concave_geom, asfit::Polyline& reference_line);
-    bool projection(const asfit::Polyline& reference_line, const std::vector<asfit::Point>& pcl_points, std::vector<asfit::Point>& projected_pcl_points);
-    bool fitting_pcl_points(std::vector<asfit::Point>& projected_pcl_points, std::vector<std::vector<double>>& result, const double& density);
+    /* Intermediate buffers of one fitting, reused by the clusters of a batch worker. */
+    struct Workspace
+    {
+        std::vector<double> pointsets;
+        asfit::PointCloud pcl_points;
+        asfit::PointCloud concave_geom;
+        asfit::PointCloud reference_line;
+        asfit::PointCloud projected_pcl_points;
+        std::vector<double> sarray;
+        std::vector<double> warray;     // weights in the order of projected_pcl_points
+        std::vector<size_t> order;
+        asfit::RadixSort sorter;
+        FitWorkspace fit;
+        FitStats stats;
+        bool parallel = true;   // stages may run on their own threads, false on the workers of fit_batch()
+    };
+
+    bool fitting(
+        const double* xarray, 
+        const double* yarray, 
+        const double* zarray,
+        const double* warray,
+        size_t n,
+        std::vector<std::vector<double>>& result,
+        double density,
+        Workspace& workspace
+    );
+    bool fitting_stages(
+        const double* xarray, 
+        const double* yarray, 
+        const double* zarray,
+        const double* warray,
+        size_t n,
+        std::vector<std::vector<double>>& result,
+        double density,
+        Workspace& workspace
+    );
+
+    bool generate_concave_hull(const std::vector<double>& pcl_points, asfit::PointCloud& concave_geom);
+    bool generate_reference_line_with_concave_hull(asfit::PointCloud& concave_geom, asfit::PointCloud& reference_line);
+    bool projection(
+        const asfit::PointCloud& reference_line, 
+        const asfit::PointCloud& pcl_points, 
+        asfit::PointCloud& projected_pcl_points,
+        Workspace& workspace);
+    bool fitting_pcl_points(
+        asfit::PointCloud& projected_pcl_points, 
+        const double* warray,
+        std::vector<std::vector<double>>& result, 
+        const double& density, 
+        FitWorkspace& workspace);
 
 private:
     double _concave_lambdans = 5e-2;
     double _lambdans = 1e-4;
     double _base_function_num = 30;
+    double _knot_spacing = 0.0;
+    double _max_base_function_num = 1000;
+    int _gcv_grid = 0;
+    double _gcv_lambdans_min = 1e-8;
+    double _gcv_lambdans_max = 1e-1;
+    bool _direct_solve = false;
+    bool _arc_length_sampling = false;
+    bool _derivatives = false;
+    size_t _workers = 0;
+    std::function<void(const FitStats&)> _stats_callback;
 };
\ No newline at end of file
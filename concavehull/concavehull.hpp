@@ -1,104 +1,331 @@
 #pragma once
 
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <limits>
-#include <set>
 #include <stdexcept>
 #include <vector>
 
 #include "delaunator.hpp"
 
 
-std::vector<double> concavehull(const std::vector<double>& coords, double chi_factor=0.1) {
+namespace concavehull_detail {
 
-	if (chi_factor < 0 || chi_factor > 1) {
-		throw std::invalid_argument("Chi factor must be between 0 and 1 inclusive");
+	// Clouds smaller than this are triangulated without thinning
+	constexpr size_t MIN_THIN_POINTS = 4096;
+	// A point is kept if an empty cell lies within this many cells of its own
+	constexpr long THIN_RADIUS = 4;
+	// Thinning pays off only if it drops at least this share of the points
+	constexpr double MIN_THIN_SHARE = 0.1;
+	// Cell size is length_param / 3 at most, the estimate gets some slack to avoid retries
+	constexpr double CELL_DIVISOR = 3.2;
+
+	inline double cross(const std::vector<double>& coords, size_t o, size_t a, size_t b) {
+		return (coords[2 * a] - coords[2 * o]) * (coords[2 * b + 1] - coords[2 * o + 1]) -
+			   (coords[2 * a + 1] - coords[2 * o + 1]) * (coords[2 * b] - coords[2 * o]);
 	}
 
-	delaunator::Delaunator d(coords);
+	// Seed triangle picked by delaunator::Delaunator, keeping it keeps the sweep order
+	inline void seed_points(const std::vector<double>& coords, size_t seeds[3]) {
+		size_t n = coords.size() >> 1;
+		double max_x = std::numeric_limits<double>::min();
+		double max_y = std::numeric_limits<double>::min();
+		double min_x = std::numeric_limits<double>::max();
+		double min_y = std::numeric_limits<double>::max();
+		for (size_t i = 0; i < n; i++) {
+			min_x = std::min(min_x, coords[2 * i]);
+			min_y = std::min(min_y, coords[2 * i + 1]);
+			max_x = std::max(max_x, coords[2 * i]);
+			max_y = std::max(max_y, coords[2 * i + 1]);
+		}
+		const double cx = (min_x + max_x) / 2;
+		const double cy = (min_y + max_y) / 2;
 
-	// Determine initial points on outside hull
-	std::vector<size_t> bpoints = d.get_hull_points();
-	std::set<size_t> bset(bpoints.begin(), bpoints.end());
+		seeds[0] = seeds[1] = seeds[2] = delaunator::INVALID_INDEX;
+		double min_dist = std::numeric_limits<double>::max();
+		for (size_t i = 0; i < n; i++) {
+			const double d = delaunator::dist(cx, cy, coords[2 * i], coords[2 * i + 1]);
+			if (d < min_dist) {
+				seeds[0] = i;
+				min_dist = d;
+			}
+		}
+		const double i0x = coords[2 * seeds[0]];
+		const double i0y = coords[2 * seeds[0] + 1];
+		min_dist = std::numeric_limits<double>::max();
+		for (size_t i = 0; i < n; i++) {
+			if (i == seeds[0]) continue;
+			const double d = delaunator::dist(i0x, i0y, coords[2 * i], coords[2 * i + 1]);
+			if (d < min_dist && d > 0.0) {
+				seeds[1] = i;
+				min_dist = d;
+			}
+		}
+		if (seeds[1] == delaunator::INVALID_INDEX) return;
+		const double i1x = coords[2 * seeds[1]];
+		const double i1y = coords[2 * seeds[1] + 1];
+		double min_radius = std::numeric_limits<double>::max();
+		for (size_t i = 0; i < n; i++) {
+			if (i == seeds[0] || i == seeds[1]) continue;
+			const double r = delaunator::circumradius(i0x, i0y, i1x, i1y, coords[2 * i], coords[2 * i + 1]);
+			if (r < min_radius) {
+				seeds[2] = i;
+				min_radius = r;
+			}
+		}
+	}
 
-	// Make max heap of boundary edges with lengths
-	typedef std::pair<size_t, double> hpair;
-	
-	auto cmp = [](hpair left, hpair right) {
-			   return left.second < right.second;
-		   };
-	
-	std::vector<hpair> bheap(bpoints.size());
+	// Shortest and longest edge of the convex hull of the row and column extreme points,
+	// an estimate of the hull of delaunator::Delaunator which the caller checks afterwards
+	inline bool convex_hull_lengths(const std::vector<double>& coords, double& min_len, double& max_len) {
+		const size_t buckets = 1024;
+		size_t n = coords.size() >> 1;
+		if (n < 3) return false;
+		double min_x = std::numeric_limits<double>::max(), min_y = min_x;
+		double max_x = -min_x, max_y = -min_x;
+		for (size_t i = 0; i < n; i++) {
+			min_x = std::min(min_x, coords[2 * i]);
+			min_y = std::min(min_y, coords[2 * i + 1]);
+			max_x = std::max(max_x, coords[2 * i]);
+			max_y = std::max(max_y, coords[2 * i + 1]);
+		}
+		double sx = max_x > min_x ? (buckets - 1) / (max_x - min_x) : 0.0;
+		double sy = max_y > min_y ? (buckets - 1) / (max_y - min_y) : 0.0;
 
-	double max_len = std::numeric_limits<double>::min();
-	double min_len = std::numeric_limits<double>::max();
-	
-	for (auto point : bpoints) {
-		size_t e = d.hull_tri[point];
-		double len = d.edge_length(e);
+		// leftmost and rightmost point of every row, lowest and highest of every column
+		std::vector<size_t> extremes(4 * buckets, delaunator::INVALID_INDEX);
+		auto update = [&](size_t slot, size_t i, int axis, bool lower) {
+			size_t& j = extremes[slot];
+			if (j == delaunator::INVALID_INDEX ||
+				(lower ? coords[2 * i + axis] < coords[2 * j + axis] : coords[2 * i + axis] > coords[2 * j + axis])) j = i;
+		};
+		for (size_t i = 0; i < n; i++) {
+			size_t col = size_t((coords[2 * i] - min_x) * sx);
+			size_t row = size_t((coords[2 * i + 1] - min_y) * sy);
+			update(4 * row, i, 0, true);
+			update(4 * row + 1, i, 0, false);
+			update(4 * col + 2, i, 1, true);
+			update(4 * col + 3, i, 1, false);
+		}
+		std::vector<size_t> candidates;
+		for (auto i : extremes) {
+			if (i != delaunator::INVALID_INDEX) candidates.push_back(i);
+		}
 
-		bheap.push_back({e, len});
-		std::push_heap(bheap.begin(), bheap.end(), cmp);
+		// monotone chain
+		std::sort(candidates.begin(), candidates.end(), [&coords](size_t a, size_t b) {
+			return coords[2 * a] < coords[2 * b] || (coords[2 * a] == coords[2 * b] && coords[2 * a + 1] < coords[2 * b + 1]);
+		});
+		candidates.erase(std::unique(candidates.begin(), candidates.end(), [&coords](size_t a, size_t b) {
+			return coords[2 * a] == coords[2 * b] && coords[2 * a + 1] == coords[2 * b + 1];
+		}), candidates.end());
+		if (candidates.size() < 3) return false;
+		std::vector<size_t> hull;
+		for (int pass = 0; pass < 2; pass++) {
+			size_t base = hull.size();
+			for (size_t k = 0; k < candidates.size(); k++) {
+				size_t i = pass == 0 ? candidates[k] : candidates[candidates.size() - 1 - k];
+				while (hull.size() >= base + 2 && cross(coords, hull[hull.size() - 2], hull.back(), i) <= 0) hull.pop_back();
+				hull.push_back(i);
+			}
+			hull.pop_back();
+		}
 
-		min_len = std::min(len, min_len);
-		max_len = std::max(len, max_len);
+		min_len = std::numeric_limits<double>::max();
+		max_len = 0.0;
+		for (size_t k = 0; k < hull.size(); k++) {
+			size_t a = hull[k], b = hull[(k + 1) % hull.size()];
+			double len = std::sqrt(delaunator::dist(coords[2 * a], coords[2 * a + 1], coords[2 * b], coords[2 * b + 1]));
+			min_len = std::min(min_len, len);
+			max_len = std::max(max_len, len);
+		}
+		return hull.size() >= 3;
 	}
 
-	// Determine length parameter
-	double length_param = chi_factor * max_len + (1 - chi_factor) * min_len;
+	// Drop the points far from every empty grid cell. With cell <= length_param / 3 every
+	// triangle the digging opens has an empty cell within THIN_RADIUS cells of its corners,
+	// so the digging only meets kept points and the hull stays the same.
+	inline bool thin_interior(const std::vector<double>& coords, double cell, std::vector<double>& thinned) {
+		size_t n = coords.size() >> 1;
+		if (!(cell > 0)) return false;
+		double min_x = std::numeric_limits<double>::max(), min_y = min_x;
+		double max_x = -min_x, max_y = -min_x;
+		for (size_t i = 0; i < n; i++) {
+			min_x = std::min(min_x, coords[2 * i]);
+			min_y = std::min(min_y, coords[2 * i + 1]);
+			max_x = std::max(max_x, coords[2 * i]);
+			max_y = std::max(max_y, coords[2 * i + 1]);
+		}
+		double fx = std::floor((max_x - min_x) / cell) + 1 + 2 * THIN_RADIUS;
+		double fy = std::floor((max_y - min_y) / cell) + 1 + 2 * THIN_RADIUS;
+		if (!(fx * fy <= 4.0 * n + 4096)) return false;
+		long nx = long(fx), ny = long(fy);
 
-	// Iteratively add points to boundary by iterating over the triangles on the hull
-	while (!bheap.empty()) {
+		// occupied cells, padded with THIN_RADIUS empty cells
+		std::vector<uint32_t> cells(n);
+		std::vector<char> occupied(nx * ny, 0);
+		for (size_t i = 0; i < n; i++) {
+			long cx = std::min(long((coords[2 * i] - min_x) / cell), nx - 1 - 2 * THIN_RADIUS) + THIN_RADIUS;
+			long cy = std::min(long((coords[2 * i + 1] - min_y) / cell), ny - 1 - 2 * THIN_RADIUS) + THIN_RADIUS;
+			cells[i] = uint32_t(cy * nx + cx);
+			occupied[cells[i]] = 1;
+		}
 
-		// Get edge with the largest length
-		std::pop_heap(bheap.begin(), bheap.end(), cmp);
-		const auto [e, len] = bheap.back();
-		bheap.pop_back();
+		// summed area table of the empty cells
+		std::vector<uint32_t> sat((nx + 1) * (ny + 1), 0);
+		for (long y = 0; y < ny; y++) {
+			uint32_t row = 0;
+			for (long x = 0; x < nx; x++) {
+				row += occupied[y * nx + x] ? 0 : 1;
+				sat[(y + 1) * (nx + 1) + x + 1] = sat[y * (nx + 1) + x + 1] + row;
+			}
+		}
+		auto near_empty = [&](uint32_t c) {
+			long cx = long(c) % nx, cy = long(c) / nx;
+			long x0 = cx - THIN_RADIUS, x1 = cx + THIN_RADIUS + 1;
+			long y0 = cy - THIN_RADIUS, y1 = cy + THIN_RADIUS + 1;
+			return sat[y1 * (nx + 1) + x1] - sat[y0 * (nx + 1) + x1] - sat[y1 * (nx + 1) + x0] + sat[y0 * (nx + 1) + x0] > 0;
+		};
+
+		std::vector<bool> keep(n);
+		size_t kept = 0;
+		for (size_t i = 0; i < n; i++) {
+			keep[i] = near_empty(cells[i]);
+			kept += keep[i];
+		}
+		if (kept + 3 >= n * (1 - MIN_THIN_SHARE)) return false;
 
-		// Length of edge too small for our chi factor
-		if (len <= length_param) {
-			break;
+		size_t seeds[3];
+		seed_points(coords, seeds);
+		thinned.clear();
+		thinned.reserve(2 * (kept + 3));
+		for (size_t i = 0; i < n; i++) {
+			if (keep[i] || i == seeds[0] || i == seeds[1] || i == seeds[2]) {
+				thinned.push_back(coords[2 * i]);
+				thinned.push_back(coords[2 * i + 1]);
+			}
 		}
+		return true;
+	}
+
+	// Dig the concave hull from the Delaunay triangulation of coords
+	inline std::vector<double> dig(const std::vector<double>& coords, double chi_factor, double& length_param) {
 
-		// Find interior point given edge e (a -> b)
-		//       e
-		//  b <----- a
-		//     \   /
-		//  e_b \ / e_a
-		//       c
-		size_t c = d.get_interior_point(e);
+		delaunator::Delaunator d(coords);
 
-		// Point already belongs to boundary
-		if (bset.count(c)) {
-			continue;
+		// Determine initial points on outside hull
+		std::vector<size_t> bpoints = d.get_hull_points();
+		std::vector<bool> bset(coords.size() >> 1, false);
+		for (auto point : bpoints) bset[point] = true;
+
+		// Make max heap of boundary edges with lengths
+		typedef std::pair<size_t, double> hpair;
+	
+		auto cmp = [](hpair left, hpair right) {
+				   return left.second < right.second;
+			   };
+	
+		std::vector<hpair> bheap;
+		bheap.reserve(bpoints.size());
+
+		double max_len = std::numeric_limits<double>::min();
+		double min_len = std::numeric_limits<double>::max();
+	
+		for (auto point : bpoints) {
+			size_t e = d.hull_tri[point];
+			double len = d.edge_length(e);
+
+			bheap.push_back({e, len});
+			std::push_heap(bheap.begin(), bheap.end(), cmp);
+
+			min_len = std::min(len, min_len);
+			max_len = std::max(len, max_len);
 		}
 
-		// Get two edges connected to interior point
-		//  c -> b
-		size_t e_b = d.halfedges[delaunator::next_halfedge(e)];
-		//  a -> c
-		size_t e_a = d.halfedges[delaunator::next_halfedge(delaunator::next_halfedge(e))];
+		// Determine length parameter
+		length_param = chi_factor * max_len + (1 - chi_factor) * min_len;
+
+		// Iteratively add points to boundary by iterating over the triangles on the hull
+		while (!bheap.empty()) {
+
+			// Get edge with the largest length
+			std::pop_heap(bheap.begin(), bheap.end(), cmp);
+			const auto [e, len] = bheap.back();
+			bheap.pop_back();
+
+			// Length of edge too small for our chi factor
+			if (len <= length_param) {
+				break;
+			}
+
+			// Find interior point given edge e (a -> b)
+			//       e
+			//  b <----- a
+			//     \   /
+			//  e_b \ / e_a
+			//       c
+			size_t c = d.get_interior_point(e);
+
+			// Point already belongs to boundary
+			if (bset[c]) {
+				continue;
+			}
 
-		// Add edges to heap
-		double len_a = d.edge_length(e_a);
-		double len_b = d.edge_length(e_b);
+			// Get two edges connected to interior point
+			//  c -> b
+			size_t e_b = d.halfedges[delaunator::next_halfedge(e)];
+			//  a -> c
+			size_t e_a = d.halfedges[delaunator::next_halfedge(delaunator::next_halfedge(e))];
 
-		bheap.push_back({e_a, len_a});
-		std::push_heap(bheap.begin(), bheap.end(), cmp);
-		bheap.push_back({e_b, len_b});
-		std::push_heap(bheap.begin(), bheap.end(), cmp);
+			// Add edges to heap
+			double len_a = d.edge_length(e_a);
+			double len_b = d.edge_length(e_b);
+
+			bheap.push_back({e_a, len_a});
+			std::push_heap(bheap.begin(), bheap.end(), cmp);
+			bheap.push_back({e_b, len_b});
+			std::push_heap(bheap.begin(), bheap.end(), cmp);
 		
-		// Update outer hull and connect new edges
-		size_t a = d.triangles[e];
-		size_t b = d.triangles[delaunator::next_halfedge(e)];
+			// Update outer hull and connect new edges
+			size_t a = d.triangles[e];
+			size_t b = d.triangles[delaunator::next_halfedge(e)];
 
-		d.hull_next[c] = b;
-		d.hull_prev[c] = a;
-		d.hull_next[a] = d.hull_prev[b] = c;
+			d.hull_next[c] = b;
+			d.hull_prev[c] = a;
+			d.hull_next[a] = d.hull_prev[b] = c;
 		
-		bset.insert(c);	
+			bset[c] = true;
+		}
+
+		return d.get_hull_coords();
 	}
+}
 
-	return d.get_hull_coords();
-}
\ No newline at end of file
+
+inline std::vector<double> concavehull(const std::vector<double>& coords, double chi_factor=0.1) {
+
+	if (chi_factor < 0 || chi_factor > 1) {
+		throw std::invalid_argument("Chi factor must be between 0 and 1 inclusive");
+	}
+
+	// Thin the interior of large clouds with a cell from the convex hull estimate of the
+	// length parameter, retry with the exact one if the estimate was too large
+	double cell = 0.0;
+	double min_len = 0.0, max_len = 0.0;
+	if (coords.size() >> 1 >= concavehull_detail::MIN_THIN_POINTS &&
+		concavehull_detail::convex_hull_lengths(coords, min_len, max_len)) {
+		cell = (chi_factor * max_len + (1 - chi_factor) * min_len) / concavehull_detail::CELL_DIVISOR;
+	}
+	std::vector<double> thinned;
+	for (int attempt = 0; attempt < 2 && cell > 0; attempt++) {
+		if (!concavehull_detail::thin_interior(coords, cell, thinned)) break;
+		double length_param = 0.0;
+		std::vector<double> hull = concavehull_detail::dig(thinned, chi_factor, length_param);
+		if (3 * cell <= length_param) return hull;
+		cell = length_param / 3;
+	}
+	double length_param = 0.0;
+	return concavehull_detail::dig(coords, chi_factor, length_param);
+}
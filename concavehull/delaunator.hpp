@@ -11,11 +11,11 @@
 
 namespace delaunator {
 
-	size_t next_halfedge(size_t e) {
+	inline size_t next_halfedge(size_t e) {
 		return (e % 3 == 2) ? e - 2 : e + 1;
 	}
 	
-	size_t prev_halfedge(size_t e) {
+	inline size_t prev_halfedge(size_t e) {
 		return (e % 3 == 0) ? e + 2 : e - 1;
 	}
 	
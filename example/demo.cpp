@@ -1,49 +1,11 @@
 #include <fstream>
-#include <sstream>
 #include <vector>
-#include <list>
 #include <stdio.h>
 #include <iostream>
 
 #include "alglib_spline_fitting.h"
 #include "chp_spline_fitting.h"
-
-/* Split string by token, and save it into a list.*/
-template<typename T>
-bool split(const std::string& input, std::list<T>& result, const char& token = ',' )
-{
-    std::istringstream ss(input);
-    std::string element;
-    result.clear();
-    while(std::getline(ss, element, token)){
-        try
-        {
-            if (std::is_same<T, double>::value) {
-                double value = std::stod(element);
-                result.push_back(value);
-            } else if (std::is_same<T, float>::value) {
-                float value = std::stof(element);
-                result.push_back(value);
-            } else if (std::is_same<T, int>::value) {
-                int value = std::stoi(element);
-                result.push_back(value);
-            }
-            // } else if (std::is_same<T, std::string>::value) {
-            //     result.push_back(element);
-            // }
-            else {
-                std::cout << "ERROR.split(): the list type is unknown." << std::endl;
-                return false;
-            }            
-        }
-        catch(const std::exception& e)
-        {
-            std::cerr << "ERROR.split(): split failed, " << e.what() << ".\n";
-            return false;
-        }
-    }
-    return true;
-}
+#include "utils/point_cloud_io.h"
 
 /* Calculate length by x and y.*/
 inline double length(const double& x0, const double& y0, const double& x1, const double& y1)
@@ -51,36 +13,15 @@ inline double length(const double& x0, const double& y0, const double& x1, const
     return std::sqrt((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0));
 }
 
-/* Read points from txt and save to list<double>.*/
-bool reader(const std::string& file_path, std::list<double>& x, std::list<double>& y, std::list<double>& z)
+/* Read points from txt and save to vector<double>.*/
+bool reader(const std::string& file_path, std::vector<double>& x, std::vector<double>& y, std::vector<double>& z)
 {
-    std::ifstream file(file_path);
-    std::string line;
-    if(file.is_open()) {
-        std::list<double> coords;
-        while(std::getline(file, line)){
-            if(split<double>(line, coords, ' ')){
-                if(coords.size() < 3){
-                    continue;
-                }
-                auto iter = coords.begin();
-                x.push_back(*iter);
-                ++iter;
-                y.push_back(*iter);
-                ++iter;
-                z.push_back(*iter);
-            }
-        }
-        file.close();
-        if(x.size() != y.size() || y.size() != z.size()){
-            std::cout << "ERROR.reader(): x y z size are not equal.\n";
-            return false;
-        }
-        return true;
-    } else{
-        std::cout << "ERROR.reader(): unable to open file.\n";
-        return false;
-    }
+    asfit::PointCloud cloud;
+    if(!asfit::read_xyz(file_path, cloud)) return false;
+    x.swap(cloud.x);
+    y.swap(cloud.y);
+    z.swap(cloud.z);
+    return true;
 }
 
 /* write data to file.*/
@@ -106,17 +47,6 @@ void writer(const std::string& filename, std::vector<std::vector<double>>& resul
     }
 }
 
-/* Save data to vector.*/
-bool convertor(std::list<double>& src, std::vector<double>& target)
-{
-    target.reserve(src.size());
-    for(auto item : src){
-        target.push_back(item);
-    }
-    src.clear();
-    return true;
-}
-
 /* Calculate s array by x and y list.*/
 bool calculator(std::vector<double>& x, std::vector<double>& y, std::vector<double>& s)
 {
@@ -152,13 +82,9 @@ int main(int argc, char **argv)
     int base_function_num = 30;
     double lambdans = 1e-4;
 
-    // step 01. read and convert the data
-    std::list<double> x_list, y_list, z_list;
+    // step 01. read the data
     std::vector<double> x_vec, y_vec, z_vec, s_vec;
-    if(!reader("lane_pointcloud.txt", x_list, y_list, z_list)) return 0;
-    convertor(x_list, x_vec);
-    convertor(y_list, y_vec);
-    convertor(z_list, z_vec);
+    if(!reader("lane_pointcloud.txt", x_vec, y_vec, z_vec)) return 0;
 
     // step 02. use class
     std::vector<std::vector<double>> result;
@@ -0,0 +1,232 @@
+#include "streaming_spline_fitting.h"
+
+#include <iostream>
+#include <algorithm>
+#include <math.h>
+
+namespace
+{
+    /* Quintic smoothstep, 0 at u = 0 and 1 at u = 1 with zero first and second derivatives at both ends. */
+    inline double smoothstep5(double u)
+    {
+        return u * u * u * (10.0 + u * (-15.0 + u * 6.0));
+    }
+
+    /* Remove the first count values of every buffer, the capacity is kept. */
+    inline void drop_front(std::vector<double>& values, size_t count)
+    {
+        values.erase(values.begin(), values.begin() + count);
+    }
+}
+
+bool StreamingSplineFitting::push(
+    const std::vector<double>& xarray,
+    const std::vector<double>& yarray,
+    const std::vector<double>& zarray,
+    std::vector<std::vector<double>>& result)
+{
+    if(xarray.size() != yarray.size() || yarray.size() != zarray.size()){
+        std::cout << "ERROR.push(): x y z size are not equal.\n";
+        return false;
+    }
+    return push(xarray.data(), yarray.data(), zarray.data(), xarray.size(), result);
+}
+
+bool StreamingSplineFitting::push(
+    const double* xarray,
+    const double* yarray,
+    const double* zarray,
+    size_t n,
+    std::vector<std::vector<double>>& result)
+{
+    // step 01. check value
+    if(!check_params()) return false;
+    result.resize(3);
+
+    // a failed push drops its samples from result and the whole trajectory
+    size_t first = result.at(0).size();
+    auto fail = [this, first, &result](){
+        for(size_t k = 0; k < 3; k++) result.at(k).resize(std::min(first, result.at(k).size()));
+        reset();
+        return false;
+    };
+
+    // a gap of the points longer than one knot spacing would only be extrapolated by the windows around it
+    double spacing = _window_length / std::max(4.0, _base_function_num);
+    for(size_t i = 0; i < n; i++){
+        if(!std::isfinite(xarray[i]) || !std::isfinite(yarray[i]) || !std::isfinite(zarray[i])){
+            std::cout << "ERROR.push(): point contains infinite or NAN values.\n";
+            return fail();
+        }
+        // step 02. accumulate the arc length and buffer the point
+        if(_points == 0){
+            _sout = 0.0;
+            _windows = 0;
+        }else{
+            double dx = xarray[i] - _xlast, dy = yarray[i] - _ylast;
+            double gap = std::sqrt(dx * dx + dy * dy);
+            if(gap > spacing){
+                std::cout
+                    << "ERROR.push(): the gap of the points after s=" << std::to_string(_sout)
+                    << " is longer than the knot spacing.\n";
+                return fail();
+            }
+            _sout += gap;
+        }
+        _xlast = xarray[i];
+        _ylast = yarray[i];
+        ++_points;
+        _x.push_back(xarray[i]);
+        _y.push_back(yarray[i]);
+        _z.push_back(zarray[i]);
+        _s.push_back(_sout);
+
+        // step 03. fit every window the point completes, emit the samples before the next window
+        while(_sout > _wstart + _window_length){
+            // the points must cover the window from its start to its end within one knot spacing
+            double wend = _wstart + _window_length;
+            double wnext = wend - _overlap;
+            size_t inside = std::upper_bound(_s.begin(), _s.end(), wend) - _s.begin();
+            if(inside == 0 || _s.front() > _wstart + spacing || _s[inside - 1] < wend - spacing){
+                std::cout
+                    << "ERROR.push(): the points do not cover the window starting at s="
+                    << std::to_string(_wstart) << ".\n";
+                return fail();
+            }
+            size_t count = 0;
+            if(!fit_window(_wstart + _window_length, count)) return fail();
+            emit(wnext, false, result);
+
+            // step 04. keep the spline for the next overlap, drop the points before the next window
+            std::swap(_previous, _workspace.splines);
+            _has_previous = _overlap > 0.0;
+            size_t drop = std::lower_bound(_s.begin(), _s.end(), wnext) - _s.begin();
+            drop_front(_x, drop);
+            drop_front(_y, drop);
+            drop_front(_z, drop);
+            drop_front(_s, drop);
+            _wstart = wnext;
+        }
+    }
+    return true;
+}
+
+bool StreamingSplineFitting::finish(std::vector<std::vector<double>>& result)
+{
+    // step 01. check value
+    if(!check_params()) return false;
+    if(_points < 2){
+        std::cout << "ERROR.finish(): less than 2 points are pushed.\n";
+        reset();
+        return false;
+    }
+    result.resize(3);
+
+    // step 02. fit the last window with all the buffered points
+    size_t count = 0;
+    if(!fit_window(_sout, count)){
+        reset();
+        return false;
+    }
+
+    // step 03. remaining samples and the end point
+    emit(_sout, true, result);
+    if(_next == 0 || _sout - (_next - 1) * _density > 1e-3 * _density){
+        emit_samples(_sout, 0.0, 1, result);
+    }
+    reset();
+    return true;
+}
+
+void StreamingSplineFitting::reset()
+{
+    _x.clear();
+    _y.clear();
+    _z.clear();
+    _s.clear();
+    _wstart = 0.0;
+    _has_previous = false;
+    _next = 0;
+    _points = 0;
+}
+
+bool StreamingSplineFitting::check_params() const
+{
+    if(!(_density > 0.0) || !(_window_length > 0.0)){
+        std::cout << "ERROR.check_params(): density and window_length must be positive.\n";
+        return false;
+    }
+    if(!(_overlap >= 0.0) || _overlap > _window_length / 2){
+        std::cout << "ERROR.check_params(): overlap must be in [0, window_length / 2].\n";
+        return false;
+    }
+    return true;
+}
+
+bool StreamingSplineFitting::fit_window(double send, size_t& count)
+{
+    // step 01. buffered points inside the window
+    count = std::upper_bound(_s.begin(), _s.end(), send) - _s.begin();
+    if(count < 2){
+        std::cout
+            << "ERROR.fit_window(): less than 2 points in the window starting at s="
+            << std::to_string(_wstart) << ", the gap of the points is longer than the window.\n";
+        return false;
+    }
+
+    // step 02. the same knot spacing for a shorter window
+    double ratio = std::min(1.0, (send - _wstart) / _window_length);
+    asfit::PenalizedSpline& solver = _workspace.solver;
+    solver.lambdans() = _lambdans;
+    solver.base_function_num() = std::max(4.0, std::ceil(_base_function_num * ratio));
+
+    // step 03. fit x, y and z with the design matrix of s
+    _workspace.inputs.assign({_x.data(), _y.data(), _z.data()});
+    if(!solver.fitting(_s.data(), _workspace.inputs, count, _workspace.hermites, _workspace.reps)){
+        return false;
+    }
+    if(!_workspace.splines.build(_workspace.hermites)) return false;
+    ++_windows;
+    return true;
+}
+
+void StreamingSplineFitting::emit(double send, bool inclusive, std::vector<std::vector<double>>& result)
+{
+    size_t end = _next;
+    while(end * _density < send || (inclusive && end * _density == send)) ++end;
+    emit_samples(_next * _density, _density, end - _next, result);
+    _next = end;
+}
+
+void StreamingSplineFitting::emit_samples(double t0, double step, size_t cnt, std::vector<std::vector<double>>& result)
+{
+    if(cnt == 0) return;
+
+    // step 01. current window
+    std::vector<double*>& out = _workspace.outputs;
+    out.resize(3);
+    size_t first = result.at(0).size();
+    for(size_t k = 0; k < 3; k++){
+        result.at(k).resize(first + cnt);
+        out[k] = result.at(k).data() + first;
+    }
+    _workspace.splines.calc(t0, step, cnt, out);
+
+    // step 02. blend the samples inside the overlap with the previous window
+    if(!_has_previous) return;
+    double bend = _wstart + _overlap;
+    size_t nb = 0;
+    while(nb < cnt && t0 + nb * step < bend) ++nb;
+    if(nb == 0) return;
+    _blend.resize(3 * nb);
+    for(size_t k = 0; k < 3; k++) out[k] = _blend.data() + k * nb;
+    _previous.calc(t0, step, nb, out);
+    for(size_t j = 0; j < nb; j++){
+        double u = std::max(0.0, (t0 + j * step - _wstart) / _overlap);
+        double w = smoothstep5(u);
+        for(size_t k = 0; k < 3; k++){
+            double& value = result.at(k)[first + j];
+            value = (1.0 - w) * _blend[k * nb + j] + w * value;
+        }
+    }
+}
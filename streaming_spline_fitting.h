@@ -0,0 +1,127 @@
+// @Description: Streaming Spline Fitting over Overlapping Arc Length Windows
+// @Time       : 2026/10/19 09:40
+// @Author     : tongjx
+
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "alglib_spline_fitting.h"
+
+/**
+ * STREAMING SPLINE FITTING
+ *
+ * Description:
+ *    Parameter spline fitting of an unbounded trajectory, e.g. the lane points of a long drive,
+ *    the points are pushed chunk by chunk in driving order.
+ *    The arc length s is accumulated as ASF_PARAM of AlglibSplineFitting does, the points are
+ *    fitted in windows [w, w + window_length] with w stepping by window_length - overlap.
+ *    Inside the overlap of two windows the splines are blended with the quintic smoothstep
+ *    weight, whose first and second derivatives vanish at both ends, so the output is C2.
+ *    Samples at s = i * density are appended to the result once no later window touches them,
+ *    only the points of the current window are kept, so the memory is bounded by the window
+ *    instead of the drive length.
+ * Parameters:
+ *    @lambdans: 1e-4 as default, nonlinearity penalty of every window
+ *    @base_function_num: 30 as default, base function number of a whole window,
+ *                        a shorter last window uses a proportional number
+ *    @window_length: 200m as default, arc length of a window
+ *    @overlap: 50m as default, arc length shared by two neighbour windows, at most window_length / 2
+ *    @density: 1.0m as default, generate points every 1.0 meter
+*/
+class StreamingSplineFitting
+{
+public:
+    StreamingSplineFitting(){}
+    ~StreamingSplineFitting(){}
+
+public:
+    double& lambdans(){ return _lambdans; }
+    double& base_function_num() { return _base_function_num; }
+    double& window_length() { return _window_length; }
+    double& overlap() { return _overlap; }
+    double& density() { return _density; }
+    // windows fitted of the current or the last finished trajectory
+    size_t windows() const { return _windows; }
+    // arc length of the current or the last finished trajectory
+    double length() const { return _sout; }
+
+public:
+    /**
+     * PUSH
+     *
+     * Description:
+     *    append the next points of the trajectory, fit every window they complete and append the
+     *    finished samples to result, which may be cleared by the caller between the pushes,
+     *    a gap between two points longer than the knot spacing window_length / base_function_num
+     *    is rejected instead of extrapolated by the windows around it
+     *    NOTE: 1. the parameters MUST NOT be changed between reset() and finish()
+     *          2. a failed push removes its samples from result and calls reset(),
+     *             the next push starts a new trajectory
+     * Parameters:
+     *    @xarray:  x coordinates, UTM
+     *    @yarray:  y coordinates, UTM
+     *    @zarray:  z coordinates
+     *    @n:       number of points of every array
+     *    @result:  [[x], [y], [z]] finished samples are appended
+     * Return:
+     *    ture if push successs, otherwise return false
+    */
+    bool push(
+        const double* xarray,
+        const double* yarray,
+        const double* zarray,
+        size_t n,
+        std::vector<std::vector<double>>& result
+    );
+    bool push(
+        const std::vector<double>& xarray,
+        const std::vector<double>& yarray,
+        const std::vector<double>& zarray,
+        std::vector<std::vector<double>>& result
+    );
+
+    /**
+     * FINISH
+     *
+     * Description:
+     *    fit the last window and append the remaining samples up to the end of the trajectory,
+     *    the last sample is the end point, then reset() for the next trajectory
+     * Parameters:
+     *    @result:  [[x], [y], [z]] remaining samples are appended
+     * Return:
+     *    ture if fitting successs, otherwise return false
+    */
+    bool finish(std::vector<std::vector<double>>& result);
+
+    // drop the buffered points and the fitted windows, the parameters are kept
+    void reset();
+
+private:
+    bool check_params() const;
+    // fit the buffered points with s <= send as the window starting at _wstart
+    bool fit_window(double send, size_t& count);
+    // append the samples with s < send, or s <= send if inclusive
+    void emit(double send, bool inclusive, std::vector<std::vector<double>>& result);
+    // append the samples t0 + j * step, j < cnt, blended with the previous window inside the overlap
+    void emit_samples(double t0, double step, size_t cnt, std::vector<std::vector<double>>& result);
+
+private:
+    double _lambdans = 1e-4;
+    double _base_function_num = 30;
+    double _window_length = 200.0;
+    double _overlap = 50.0;
+    double _density = 1.0;
+
+    std::vector<double> _x, _y, _z, _s;     // buffered points of the current window
+    double _wstart = 0.0;                   // start of the current window
+    bool _has_previous = false;             // a previous window exists to blend with
+    size_t _next = 0;                       // index of the next sample s = _next * density
+    size_t _points = 0;                     // points pushed since the last reset()
+    size_t _windows = 0;
+    double _sout = 0.0;                     // arc length of the last pushed point
+    double _xlast = 0.0, _ylast = 0.0;
+
+    FitWorkspace _workspace;
+    asfit::PiecewiseCubic _previous;        // spline of the previous window
+    std::vector<double> _blend;             // previous window values inside the overlap
+};
@@ -1,7 +1,5 @@
 #include <fstream>
-#include <sstream>
 #include <vector>
-#include <list>
 #include <tuple>
 #include <unordered_set>
 #include <stdio.h>
@@ -13,13 +11,15 @@
 
 #include "alglib_spline_fitting.h"
 #include "chp_spline_fitting.h"
+#include "utils/point_cloud_io.h"
 
 using namespace asfit;
 
 /* Order Method. */
 struct MyLess
 {
-    bool operator()(const Point &a, const Point &b) const
+    template <typename P>
+    bool operator()(const P &a, const P &b) const
     {
         if (std::fabs(a.x - b.x) < std::numeric_limits<double>::epsilon()) { return a.y < b.y; }
         else { return a.x < b.x; }
@@ -27,118 +27,38 @@ struct MyLess
 };
 
 
-/* Split string by token, and save it into a list.*/
-template <typename T>
-bool split(const std::string &input, std::list<T> &result, const char &token = ',')
-{
-    std::istringstream ss(input);
-    std::string element;
-    result.clear();
-    while (std::getline(ss, element, token))
-    {
-        try
-        {
-            if (std::is_same<T, double>::value)
-            {
-                double value = std::stod(element);
-                result.push_back(value);
-            }
-            else if (std::is_same<T, float>::value)
-            {
-                float value = std::stof(element);
-                result.push_back(value);
-            }
-            else if (std::is_same<T, int>::value)
-            {
-                int value = std::stoi(element);
-                result.push_back(value);
-            }
-            // } else if (std::is_same<T, std::string>::value) {
-            //     result.push_back(element);
-            // }
-            else
-            {
-                std::cout << "ERROR.split(): the list type is unknown." << std::endl;
-                return false;
-            }
-        }
-        catch (const std::exception &e)
-        {
-            std::cerr << "ERROR.split(): split failed, " << e.what() << ".\n";
-            return false;
-        }
-    }
-    return true;
-}
-
 /* Calculate length by x and y.*/
 inline double length(const double &x0, const double &y0, const double &x1, const double &y1)
 {
     return std::sqrt((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0));
 }
 
-/* Read points from txt and save to list<double>.*/
-bool reader(const std::string &file_path, std::list<double> &x, std::list<double> &y, std::list<double> &z)
+/* Read points from txt and sort them by x.*/
+bool reader(const std::string &file_path, std::vector<double> &x, std::vector<double> &y, std::vector<double> &z)
 {
-    std::ifstream file(file_path);
-    std::string line;
-    if (file.is_open())
+    PointCloud cloud;
+    if (!read_xyz(file_path, cloud))
     {
-        std::list<double> coords;
-        std::vector<Point3D> pts;
-        while (std::getline(file, line))
-        {
-            if (split<double>(line, coords, ' '))
-            {
-                if (coords.size() < 3)
-                {
-                    continue;
-                }
-                Point3D pt;
-                auto iter = coords.begin();
-                pt.x = *iter;
-                // x.push_back(*iter);
-                ++iter;
-                pt.y = *iter;
-                // y.push_back(*iter);
-                ++iter;
-                pt.z = *iter;
-                // z.push_back(*iter);
-                pts.push_back(pt);
-            }
-        }
-        file.close();
-        if (x.size() != y.size() || y.size() != z.size())
-        {
-            std::cout << "ERROR.reader(): x y z size are not equal.\n";
-            return false;
-        }
-
-        std::sort(pts.begin(), pts.end(), MyLess());
-        for (auto &pt : pts)
-        {
-            x.push_back(pt.x);
-            y.push_back(pt.y);
-            z.push_back(pt.z);
-        }
-        return true;
+        return false;
     }
-    else
+    std::vector<Point3D> pts(cloud.size());
+    for (size_t i = 0; i < cloud.size(); i++)
     {
-        std::cout << "ERROR.reader(): unable to open file.\n";
-        return false;
+        pts[i].x = cloud.x[i];
+        pts[i].y = cloud.y[i];
+        pts[i].z = cloud.z[i];
     }
-}
 
-/* Save data to vector.*/
-bool convertor(std::list<double> &src, std::vector<double> &target)
-{
-    target.reserve(src.size());
-    for (auto item : src)
+    std::sort(pts.begin(), pts.end(), MyLess());
+    x.resize(pts.size());
+    y.resize(pts.size());
+    z.resize(pts.size());
+    for (size_t i = 0; i < pts.size(); i++)
     {
-        target.push_back(item);
+        x[i] = pts[i].x;
+        y[i] = pts[i].y;
+        z[i] = pts[i].z;
     }
-    src.clear();
     return true;
 }
 
@@ -202,14 +122,10 @@ int main(int argc, char **argv)
     int base_function_num = 30;
     double lambdans = 1e-4;
 
-    // step 01. read and convert the data
-    std::list<double> x_list, y_list, z_list;
+    // step 01. read the data
     std::vector<double> x_vec, y_vec, z_vec, s_vec;
-    if (!reader("lane_pointcloud12.txt", x_list, y_list, z_list))
+    if (!reader("lane_pointcloud12.txt", x_vec, y_vec, z_vec))
         return 0;
-    convertor(x_list, x_vec);
-    convertor(y_list, y_vec);
-    convertor(z_list, z_vec);
 
     // step 02. use class
     // std::vector<std::vector<double>> result;
@@ -227,11 +143,20 @@ int main(int argc, char **argv)
     ConcaveHullParamSplineFitting splinefitting;
     splinefitting.lambdans() = lambdans;
     splinefitting.base_function_num() = base_function_num;
-    if (!splinefitting.fitting(x_vec, y_vec, z_vec, result, 0.25)){
-        std::cout << "ERROR: chp spline fitting failed.\n";
+    FitStats stats;
+    if (!splinefitting.fitting(x_vec, y_vec, z_vec, result, stats, 0.25)){
+        std::cout << "ERROR: chp spline fitting failed at stage " << stats.failed_stage << ".\n";
         return 0;
     }
     writer("output-12.txt", result);
+    std::cout << "points " << stats.points << ", hull " << stats.hull_points 
+              << ", reference line " << stats.reference_line_points << ", samples " << stats.samples << "\n"
+              << "prepare " << stats.stage_ms[FitStats::PREPARE] << "ms, hull " << stats.stage_ms[FitStats::CONCAVE_HULL]
+              << "ms, reference line " << stats.stage_ms[FitStats::REFERENCE_LINE] << "ms, projection " 
+              << stats.stage_ms[FitStats::PROJECTION] << "ms, fit " << stats.stage_ms[FitStats::FIT] 
+              << "ms, total " << stats.total_ms << "ms\n"
+              << "rms error " << stats.rmserror[0] << " " << stats.rmserror[1] << " " << stats.rmserror[2] 
+              << ", lsqr iterations " << stats.lsqr_iterations[0] << "\n";
 
     return 0;
 }
\ No newline at end of file
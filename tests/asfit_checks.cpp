@@ -0,0 +1,97 @@
+// @Description: Regression Checks of the Fitting Stages, run by CTest
+// @Time       : 2026/10/21 10:20
+// @Author     : tongjx
+
+#include <cmath>
+#include <random>
+#include <vector>
+#include <iostream>
+
+#include "utils/penalized_spline.h"
+#include "streaming_spline_fitting.h"
+
+namespace
+{
+    /* Ordered samples of a 200m arc with lateral noise, cnt points. */
+    void make_arc(size_t cnt, std::vector<double>& s, std::vector<double>& x, std::vector<double>& y)
+    {
+        const double length = 200.0, radius = 300.0;
+        std::mt19937 gen(7);
+        std::normal_distribution<double> jitter(0.0, 0.1);
+        s.resize(cnt);
+        x.resize(cnt);
+        y.resize(cnt);
+        for(size_t i = 0; i < cnt; i++){
+            s[i] = length * i / (cnt - 1);
+            double heading = s[i] / radius;
+            x[i] = radius * std::sin(heading) - jitter(gen) * std::sin(heading);
+            y[i] = radius * (1 - std::cos(heading)) + jitter(gen) * std::cos(heading);
+        }
+    }
+
+    /* The base function number chosen from the knot spacing is the accepted coarse-to-fine level,
+       the same for a small input fitted directly and a large one fitted on a subsample. */
+    bool check_coarse_to_fine()
+    {
+        int levels[2] = {0, 0};
+        size_t points[2] = {3001, 20001};
+        for(int k = 0; k < 2; k++){
+            std::vector<double> s, x, y;
+            make_arc(points[k], s, x, y);
+            std::vector<const double*> ys = {x.data(), y.data()};
+            asfit::PenalizedSpline solver;
+            solver.knot_spacing() = 0.1;
+            solver.direct() = true;
+            std::vector<asfit::HermiteSpline> splines;
+            std::vector<asfit::SplineFitReport> reps;
+            if(!solver.fitting(s.data(), ys, s.size(), splines, reps)){
+                std::cout << "ERROR.check_coarse_to_fine(): fitting failed.\n";
+                return false;
+            }
+            if(splines[0].x.size() != size_t(reps[0].base_function_num)){
+                std::cout << "ERROR.check_coarse_to_fine(): the spline is not the reported level.\n";
+                return false;
+            }
+            levels[k] = reps[0].base_function_num;
+        }
+        if(levels[0] != levels[1]){
+            std::cout << "ERROR.check_coarse_to_fine(): base_function_num " << levels[0] << " of "
+                      << points[0] << " points, " << levels[1] << " of " << points[1] << " points.\n";
+            return false;
+        }
+        return true;
+    }
+
+    /* A trajectory with a gap longer than the knot spacing is rejected by the streaming fitting,
+       the same trajectory without the gap is fitted. */
+    bool check_streaming_gap()
+    {
+        for(int gapped = 0; gapped < 2; gapped++){
+            std::vector<double> x, y, z;
+            for(double s = 0.0; s <= 600.0; s += 1.0){
+                if(gapped && s > 145.0 && s < 260.0) continue;
+                x.push_back(s);
+                y.push_back(0.0);
+                z.push_back(0.0);
+            }
+            StreamingSplineFitting fitter;
+            std::vector<std::vector<double>> result;
+            bool success = fitter.push(x, y, z, result) && fitter.finish(result);
+            if(success == bool(gapped)){
+                std::cout << "ERROR.check_streaming_gap(): the " << (gapped ? "gapped" : "dense")
+                          << " trajectory is " << (success ? "accepted" : "rejected") << ".\n";
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main()
+{
+    int failed = 0;
+    failed += !check_coarse_to_fine();
+    failed += !check_streaming_gap();
+    std::cout << (failed == 0 ? "all checks passed.\n" : "some checks failed.\n");
+    return failed == 0 ? 0 : 1;
+}
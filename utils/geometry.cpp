@@ -1,121 +1,230 @@
 #include <cmath>
 #include <limits>
 #include <numeric>
+#include <algorithm>
 
 #include "geometry.h"
 
 using namespace asfit;
 
-using Vector = Point;
+namespace
+{
+    const size_t SCAN_BLOCK = 256;  // distances computed by one batch kernel call
+
+    struct ArrayCoords
+    {
+        const double* xs;
+        const double* ys;
+        // distances of the cnt points from first to the line start-end
+        void line_distances(size_t first, size_t cnt, size_t start, size_t end, double* dis) const
+        {
+            asfit::line_distances(xs + first, ys + first, cnt, xs[start], ys[start], xs[end], ys[end], dis);
+        }
+    };
+
+    struct PointCoords
+    {
+        const Point* points;
+        void line_distances(size_t first, size_t cnt, size_t start, size_t end, double* dis) const
+        {
+            const Point& p0 = points[start];
+            const Point& p1 = points[end];
+            double bx = p1.x - p0.x, by = p1.y - p0.y;
+            double lb = std::sqrt(bx * bx + by * by);
+            if(std::fabs(lb) == std::numeric_limits<double>::epsilon()){
+                for(size_t j = 0; j < cnt; j++) dis[j] = points[first + j].get_length_to_pt(p0);
+                return;
+            }
+            // the line branch of Point::get_length_to_line() hoisted out of the loop
+            for(size_t j = 0; j < cnt; j++){
+                double ax = points[first + j].x - p0.x, ay = points[first + j].y - p0.y;
+                dis[j] = std::fabs((ax * by - ay * bx) / lb);
+            }
+        }
+    };
+}
 
-inline double sign(const double& x){return x < 0 ? -1.0 : 1.0;}
+template<typename Coords>
+void DouglasPeucker::run(const Coords& coords, size_t n, std::vector<size_t>& indices, double epsilon)
+{
+    indices.clear();
+    if(n < 2) return;
+    _kept.assign((n + 63) / 64, 0);
+    auto keep = [this](size_t i){ _kept[i / 64] |= uint64_t(1) << (i % 64); };
+    keep(0);
+    keep(n - 1);
+
+    _spans.clear();
+    _spans.emplace_back(0, n - 1);
+    double dist[SCAN_BLOCK];
+    while(!_spans.empty()){
+        size_t start = _spans.back().first;
+        size_t end = _spans.back().second;
+        _spans.pop_back();
+        if(end <= start + 1) continue;
+
+        // farthest vertex, the first one of equal distances
+        double dmax = 0.0;
+        size_t index = 0;
+        for(size_t first = start + 1; first < end; first += SCAN_BLOCK){
+            size_t cnt = std::min(SCAN_BLOCK, end - first);
+            double bmax = 0.0;
+            coords.line_distances(first, cnt, start, end, dist);
+            for(size_t j = 0; j < cnt; j++) bmax = dist[j] > bmax ? dist[j] : bmax;
+            if(bmax > dmax){
+                size_t j = 0;
+                while(dist[j] != bmax) ++j;
+                dmax = bmax;
+                index = first + j;
+            }
+        }
 
-Point Point::operator+(const Point& other) const { return Point(x + other.x, y + other.y); }
-Point Point::operator-(const Point& other) const { return Point(x - other.x, y - other.y); }
-Point Point::operator*(const double& factor) const { return Point(x * factor, y * factor); }
-Point Point::operator/(const double& factor) const { return Point(x / factor, y / factor); }
+        if(dmax > epsilon){
+            keep(index);
+            _spans.emplace_back(index, end);
+            _spans.emplace_back(start, index);
+        }
+    }
 
-double Point::dot(const Point& other) const { return x * other.x + y * other.y; }
-double Point::cross(const Point& other) const { return x * other.y - y * other.x; }
-double Point::norm() const { return std::sqrt(x * x + y * y); }
+    for(size_t w = 0; w < _kept.size(); w++){
+        for(uint64_t bits = _kept[w]; bits != 0; bits &= bits - 1){
+            size_t bit = 0;
+            while(!((bits >> bit) & 1)) ++bit;
+            indices.push_back(w * 64 + bit);
+        }
+    }
+}
 
-Point Point::normalize() const
+void DouglasPeucker::simplify(const double* x, const double* y, size_t n, std::vector<size_t>& indices, double epsilon)
 {
-    double length = this->norm();
-    return Point(x / length, y / length);
+    run(ArrayCoords{x, y}, n, indices, epsilon);
 }
 
-double Point::convex(const Point& front, const Point& back) const
+void DouglasPeucker::simplify(const Point* points, size_t n, std::vector<size_t>& indices, double epsilon)
 {
-    Vector front_p = *this - front;
-    Vector p_back = back - *this;
-    double sign_tag = sign(front_p.cross(p_back));
-    double cos_value = front_p.dot(p_back) / (front_p.norm() * p_back.norm());
-    if(cos_value > 1.0) return 0.0f;
-    if(cos_value < -1.0) return M_PI;
-    return sign_tag * std::acos(cos_value);
+    run(PointCoords{points}, n, indices, epsilon);
 }
 
-double Point::get_length_to_pt(const Point& other) const
+void Polyline::douglas_peuker(std::vector<Point>& out, const double& epsilon)
 {
-    return std::sqrt((other.x - x) * (other.x - x) + (other.y - y) * (other.y - y));
+    std::vector<size_t> indices;
+    douglas_peuker(indices, epsilon);
+    out.reserve(out.size() + indices.size());
+    for(auto& i : indices) out.push_back(data[i]);
 }
 
-double Point::get_length_to_line(const Point& p0, const Point& p1) const
+void Polyline::douglas_peuker(std::vector<size_t>& indices, const double& epsilon)
 {
-    Vector a = *this - p0;
-    Vector b = p1 - p0;
-    double lb = b.norm();
-    if(fabs(lb) == std::numeric_limits<double>::epsilon()){
-        return get_length_to_pt(p0);
-    } else return std::fabs(a.cross(b) / lb);
+    _simplifier.simplify(data.data(), data.size(), indices, epsilon);
 }
 
-double Point::get_length_to_segment(const Point& p0, const Point& p1, double& ds) const
+void SegmentGrid::build(const std::vector<double>& x, const std::vector<double>& y)
 {
-    // temp vector varible
-    Vector a = *this - p0;
-    Vector c = p1 - *this;
-    Vector b = p1 - p0;
-    double dot_ab = a.dot(b);
-    double dot_cb = c.dot(b);
-    double length = b.norm();
-    // p0 and p1 is the same point
-    if(fabs(length) == std::numeric_limits<double>::epsilon()){
-        ds = 0.0;
-        return get_length_to_pt(p0);
-    }
-    // check wether project p is on the segement
-    if(dot_ab >= 0 && dot_cb >= 0){
-        ds = dot_ab / length;
-        return std::fabs(a.cross(b) / length);
-    }
-    else if(dot_ab < 0){
-        ds = dot_ab / length;
-        return get_length_to_pt(p0);
-    }
-    else{
-        ds = length - dot_cb / length;
-        return get_length_to_pt(p1);
+    _x = &x;
+    _y = &y;
+    _cell_start.clear();
+    _segments.clear();
+    int m = int(x.size()) - 1;
+    if(m < 1) { _nx = _ny = 0; return; }
+
+    // cell size: average segment length, enlarged when the grid would be too dense
+    double minx = x[0], maxx = x[0], miny = y[0], maxy = y[0];
+    double total = 0.0;
+    for(int i = 1; i <= m; i++){
+        minx = std::min(minx, x[i]);
+        maxx = std::max(maxx, x[i]);
+        miny = std::min(miny, y[i]);
+        maxy = std::max(maxy, y[i]);
+        total += Point(x[i], y[i]).get_length_to_pt(Point(x[i - 1], y[i - 1]));
     }
+    double w = maxx - minx, h = maxy - miny;
+    _cell = std::max(total / m, std::sqrt(w * h / (16.0 * m + 1024.0)));
+    _cell = std::max(_cell, std::max(w, h) / 4096.0);
+    if(!(_cell > 0.0)) _cell = 1.0;
+    _x0 = minx;
+    _y0 = miny;
+    _nx = int(w / _cell) + 1;
+    _ny = int(h / _cell) + 1;
+
+    // rasterize every segment row by row, counting first and filling second
+    double pad = _cell * 1e-9;
+    auto col = [&](double x){ return std::max(0, std::min(_nx - 1, int(std::floor((x - _x0) / _cell)))); };
+    auto row = [&](double y){ return std::max(0, std::min(_ny - 1, int(std::floor((y - _y0) / _cell)))); };
+    auto rasterize = [&](int i, auto&& visit){
+        Point p0(x[i], y[i]);
+        Point p1(x[i + 1], y[i + 1]);
+        int j0 = row(std::min(p0.y, p1.y) - pad);
+        int j1 = row(std::max(p0.y, p1.y) + pad);
+        for(int j = j0; j <= j1; j++){
+            double xa = std::min(p0.x, p1.x), xb = std::max(p0.x, p1.x);
+            if(p0.y != p1.y){
+                double ta = (_y0 + j * _cell - p0.y) / (p1.y - p0.y);
+                double tb = (_y0 + (j + 1) * _cell - p0.y) / (p1.y - p0.y);
+                if(ta > tb) std::swap(ta, tb);
+                ta = std::max(ta, 0.0);
+                tb = std::min(tb, 1.0);
+                double x_ta = p0.x + ta * (p1.x - p0.x);
+                double x_tb = p0.x + tb * (p1.x - p0.x);
+                xa = std::max(xa, std::min(x_ta, x_tb));
+                xb = std::min(xb, std::max(x_ta, x_tb));
+            }
+            for(int k = col(xa - pad); k <= col(xb + pad); k++) visit(j * _nx + k);
+        }
+    };
+    _cell_start.assign(size_t(_nx) * _ny + 1, 0);
+    for(int i = 0; i < m; i++) rasterize(i, [&](int c){ ++_cell_start[c + 1]; });
+    std::partial_sum(_cell_start.begin(), _cell_start.end(), _cell_start.begin());
+    _segments.resize(_cell_start.back());
+    std::vector<int> offset(_cell_start.begin(), _cell_start.end() - 1);
+    for(int i = 0; i < m; i++) rasterize(i, [&](int c){ _segments[offset[c]++] = i; });
 }
 
-void Polyline::douglas_peuker(std::vector<Point>& out, const double& epsilon)
+void SegmentGrid::test(const Point& pt, int i, int& best, double& dis, double& ds) const
 {
-    return douglas_peuker(data, 0, data.size() - 1, epsilon, out);
+    double ds_i = 0.0;
+    Point p0((*_x)[i], (*_y)[i]);
+    Point p1((*_x)[i + 1], (*_y)[i + 1]);
+    double dis_i = pt.get_length_to_segment(p0, p1, ds_i);
+    if(dis_i < dis || (dis_i == dis && i < best)){
+        best = i;
+        dis = dis_i;
+        ds = ds_i;
+    }
 }
 
-void Polyline::douglas_peuker(
-    const std::vector<Point>& points, 
-    int start_index, int end_index, double epsilon, 
-    std::vector<Point>& out)
+int SegmentGrid::nearest(const Point& pt, double& dis, double& ds, int hint) const
 {
-if (end_index <= start_index) { return; }
-
-    double dmax = 0;
-    int index = 0;
-
-    const Point& start = points[start_index];
-    const Point& end = points[end_index];
-
-    for (int i = start_index + 1; i < end_index; i++) {
-        double d = points[i].get_length_to_line(start, end);
-        if (d > dmax) {
-            index = i;
-            dmax = d;
-        }
+    int best = -1;
+    dis = std::numeric_limits<double>::max();
+    ds = 0.0;
+    if(_nx == 0) return best;
+
+    // seed the search with the hint and its neighbours
+    int m = int(_x->size()) - 1;
+    if(hint >= 0 && hint < m){
+        for(int i = std::max(0, hint - 1); i <= std::min(m - 1, hint + 1); i++) test(pt, i, best, dis, ds);
     }
 
-    if (dmax > epsilon) {
-        std::vector<Point> recResults1;
-        std::vector<Point> recResults2;
-        douglas_peuker(points, start_index, index, epsilon, recResults1);
-        douglas_peuker(points, index, end_index, epsilon, recResults2);
-
-        out.insert(out.end(), recResults1.begin(), recResults1.end() - 1);
-        out.insert(out.end(), recResults2.begin(), recResults2.end());
-    } else {
-        out.push_back(start);
-        out.push_back(end);
+    // visit the cells ring by ring until the ring is farther than the best segment
+    int cx = std::max(0, std::min(_nx - 1, int(std::floor((pt.x - _x0) / _cell))));
+    int cy = std::max(0, std::min(_ny - 1, int(std::floor((pt.y - _y0) / _cell))));
+    for(int r = 0; ; r++){
+        for(int j = cy - r; j <= cy + r; j++){
+            if(j < 0 || j >= _ny) continue;
+            int step = (j == cy - r || j == cy + r) ? 1 : 2 * r;
+            for(int k = cx - r; k <= cx + r; k += std::max(step, 1)){
+                if(k < 0 || k >= _nx) continue;
+                int c = j * _nx + k;
+                for(int e = _cell_start[c]; e < _cell_start[c + 1]; e++) test(pt, _segments[e], best, dis, ds);
+            }
+        }
+        double bound = std::numeric_limits<double>::max();
+        bool remains = false;
+        if(cx - r > 0) { bound = std::min(bound, pt.x - (_x0 + (cx - r) * _cell)); remains = true; }
+        if(cx + r < _nx - 1) { bound = std::min(bound, _x0 + (cx + r + 1) * _cell - pt.x); remains = true; }
+        if(cy - r > 0) { bound = std::min(bound, pt.y - (_y0 + (cy - r) * _cell)); remains = true; }
+        if(cy + r < _ny - 1) { bound = std::min(bound, _y0 + (cy + r + 1) * _cell - pt.y); remains = true; }
+        if(!remains || dis < bound) break;
     }
+    return best;
 }
\ No newline at end of file
@@ -4,13 +4,16 @@
 
 #pragma once
 
-#include <string>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
-#include <unordered_map>
+#include <utility>
+
+#include "geometry_kernels.h"
 
 namespace asfit
 {
-    /* 2D Point class.*/
+    /* 2D Point class, no virtual members, the geometry is inlined from geometry_kernels.h. */
     class Point
     {
     public:
@@ -18,48 +21,120 @@ namespace asfit
         Point(const double& X, const double& Y): x(X), y(Y){}
 
     public:
-        Point operator+(const Point& other) const;
-        Point operator-(const Point& other) const;
-        Point operator*(const double& factor) const;
-        Point operator/(const double& factor) const;
+        Point operator+(const Point& other) const { return Point(x + other.x, y + other.y); }
+        Point operator-(const Point& other) const { return Point(x - other.x, y - other.y); }
+        Point operator*(const double& factor) const { return Point(x * factor, y * factor); }
+        Point operator/(const double& factor) const { return Point(x / factor, y / factor); }
 
     public:
+        double dot(const Point& other) const { return asfit::dot(*this, other); }
+        double cross(const Point& other) const { return asfit::cross(*this, other); }
+        double norm() const { return asfit::norm(*this); }
+        Point normalize() const
+        {
+            double length = norm();
+            return Point(x / length, y / length);
+        }
         // angle of front->P and P->back, + if anticlockwise, - otherwise
-        virtual double dot(const Point& other) const;
-        virtual double cross(const Point& other) const;
-        virtual double norm() const;
-        virtual Point normalize() const;
-        virtual double convex(const Point& front, const Point& back) const;
+        double convex(const Point& front, const Point& back) const { return asfit::convex(*this, front, back); }
 
     public:
-        virtual double get_length_to_pt(const Point& other) const;
-        virtual double get_length_to_line(const Point& p0, const Point& p1) const;
+        double get_length_to_pt(const Point& other) const { return asfit::length_to_pt(*this, other); }
+        double get_length_to_line(const Point& p0, const Point& p1) const { return asfit::length_to_line(*this, p0, p1); }
         // s is the distance to p0 on the line p0-p1
-        virtual double get_length_to_segment(const Point& p0, const Point& p1, double& ds) const;
+        double get_length_to_segment(const Point& p0, const Point& p1, double& ds) const
+        {
+            return asfit::length_to_segment(*this, p0, p1, ds);
+        }
 
     public:
         double x = 0.0;
         double y = 0.0;
-        std::unordered_map<std::string, double> attributes; // attach attributes for points
     };
 
-    /* 3D Point class.*/
-    class Point3D: public Point{
+    /* 3D Point class, the plane geometry of x and y is the templates of geometry_kernels.h. */
+    class Point3D
+    {
     public:
         Point3D(){}
-        Point3D(const double& X, const double& Y, const double& Z): Point(X, Y), z(Z){}
+        Point3D(const double& X, const double& Y, const double& Z): x(X), y(Y), z(Z){}
+    public:
+        Point xy() const { return Point(x, y); }
     public:
+        double x = 0.0;
+        double y = 0.0;
         double z = 0.0;
     };
 
+    /**
+     * DOUGLAS PEUCKER
+     *
+     * Description:
+     *    Douglas-Peucker simplification without recursion, the spans to split wait on a stack
+     *    and the kept vertices are marked in a bitmap, the buffers are kept by the object.
+     *    The farthest vertex of a span is searched block by block, the distances of a block
+     *    are computed by the batch kernel line_distances(), and only a block holding a new
+     *    maximum is scanned for its first index, so the split is the same as the sequential
+     *    search with Point::get_length_to_line().
+     */
+    class DouglasPeucker
+    {
+    public:
+        /**
+         * SIMPLIFY
+         *
+         * Description:
+         *    indices of the kept vertices of the polyline in ascending order,
+         *    the first and the last vertex are always kept, nothing is kept of less than 2 vertices
+         * Parameters:
+         *    @x, y:    coordinates of n vertices, or
+         *    @points:  n vertices
+         *    @indices: kept indices, cleared first
+         *    @epsilon: 0.1 as default, vertices closer than epsilon to a span are removed
+         */
+        void simplify(const double* x, const double* y, size_t n, std::vector<size_t>& indices, double epsilon = 0.1);
+        void simplify(const Point* points, size_t n, std::vector<size_t>& indices, double epsilon = 0.1);
+    private:
+        template<typename Coords>
+        void run(const Coords& coords, size_t n, std::vector<size_t>& indices, double epsilon);
+    private:
+        std::vector<uint64_t> _kept;
+        std::vector<std::pair<size_t, size_t>> _spans;
+    };
+
     /* Polyline with 2D Point. */
     class Polyline
     {
     public:
         void douglas_peuker(std::vector<Point>& out, const double& epsilon = 0.1);
-    private:
-        void douglas_peuker(const std::vector<Point>& points, int start_index, int end_index, double epsilon, std::vector<Point>& out);
+        // indices of the kept points in data, in ascending order
+        void douglas_peuker(std::vector<size_t>& indices, const double& epsilon = 0.1);
     public:
         std::vector<Point> data;
+    private:
+        DouglasPeucker _simplifier;
+    };
+
+    /* Uniform grid over the segments of a polyline for nearest segment queries. */
+    class SegmentGrid
+    {
+    public:
+        void build(const std::vector<double>& x, const std::vector<double>& y);
+        // index i of the nearest segment (x[i], y[i])-(x[i+1], y[i+1]) to pt, the lowest index wins on ties,
+        // dis and ds are the same as pt.get_length_to_segment() of the segment,
+        // hint is a segment index to start with, e.g. the previous result for sorted points
+        int nearest(const Point& pt, double& dis, double& ds, int hint = -1) const;
+    private:
+        void test(const Point& pt, int i, int& best, double& dis, double& ds) const;
+    private:
+        const std::vector<double>* _x = nullptr;
+        const std::vector<double>* _y = nullptr;
+        double _x0 = 0.0;
+        double _y0 = 0.0;
+        double _cell = 1.0;
+        int _nx = 0;
+        int _ny = 0;
+        std::vector<int> _cell_start; // segments of cell c are _segments[_cell_start[c]] ... _segments[_cell_start[c + 1] - 1]
+        std::vector<int> _segments;
     };
 }
\ No newline at end of file
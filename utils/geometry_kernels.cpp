@@ -0,0 +1,44 @@
+#include "geometry_kernels.h"
+
+using namespace asfit;
+
+#if defined(ASFIT_GEOMETRY_AVX2)
+namespace asfit
+{
+    namespace avx2
+    {
+        // geometry_kernels_avx2.cpp, the only file built with -mavx2
+        void line_distances(const double* x, const double* y, size_t n, double x0, double y0, double x1, double y1, double* dis);
+    }
+}
+
+inline bool has_avx2()
+{
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#endif
+
+namespace
+{
+    struct XY
+    {
+        double x;
+        double y;
+    };
+}
+
+void asfit::line_distances(
+    const double* x, const double* y, size_t n,
+    double x0, double y0, double x1, double y1,
+    double* dis)
+{
+#if defined(ASFIT_GEOMETRY_AVX2)
+    if(has_avx2()){
+        avx2::line_distances(x, y, n, x0, y0, x1, y1, dis);
+        return;
+    }
+#endif
+    XY p0{x0, y0}, p1{x1, y1};
+    for(size_t i = 0; i < n; i++) dis[i] = length_to_line(XY{x[i], y[i]}, p0, p1);
+}
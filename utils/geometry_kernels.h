@@ -0,0 +1,105 @@
+// @Description: Header-only Plane Geometry Kernels and SoA Batch Variants
+// @Time       : 2026/10/20 10:15
+// @Author     : tongjx
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace asfit
+{
+    /**
+     * GEOMETRY KERNELS
+     *
+     * Description:
+     *    Plane geometry of any point type with members x and y, e.g. Point and Point3D,
+     *    the z of a 3D point is ignored. The kernels are inline templates so the hot loops
+     *    of projection, simplification and angle computation are fully inlined.
+     *    The formulas and the order of the operations are the ones of the former virtual
+     *    members of Point, the results are bit-identical.
+     */
+    template<typename P>
+    inline double dot(const P& a, const P& b) { return a.x * b.x + a.y * b.y; }
+
+    template<typename P>
+    inline double cross(const P& a, const P& b) { return a.x * b.y - a.y * b.x; }
+
+    template<typename P>
+    inline double norm(const P& a) { return std::sqrt(a.x * a.x + a.y * a.y); }
+
+    template<typename P>
+    inline double length_to_pt(const P& p, const P& other)
+    {
+        return std::sqrt((other.x - p.x) * (other.x - p.x) + (other.y - p.y) * (other.y - p.y));
+    }
+
+    // distance of p to the line p0-p1, to p0 if p0 and p1 are the same point
+    template<typename P>
+    inline double length_to_line(const P& p, const P& p0, const P& p1)
+    {
+        double ax = p.x - p0.x, ay = p.y - p0.y;
+        double bx = p1.x - p0.x, by = p1.y - p0.y;
+        double lb = std::sqrt(bx * bx + by * by);
+        if(std::fabs(lb) == std::numeric_limits<double>::epsilon()){
+            return length_to_pt(p, p0);
+        } else return std::fabs((ax * by - ay * bx) / lb);
+    }
+
+    // distance of p to the segment p0-p1, ds is the distance of the projection to p0 on the line p0-p1
+    template<typename P>
+    inline double length_to_segment(const P& p, const P& p0, const P& p1, double& ds)
+    {
+        double ax = p.x - p0.x, ay = p.y - p0.y;
+        double cx = p1.x - p.x, cy = p1.y - p.y;
+        double bx = p1.x - p0.x, by = p1.y - p0.y;
+        double dot_ab = ax * bx + ay * by;
+        double dot_cb = cx * bx + cy * by;
+        double length = std::sqrt(bx * bx + by * by);
+        // p0 and p1 is the same point
+        if(std::fabs(length) == std::numeric_limits<double>::epsilon()){
+            ds = 0.0;
+            return length_to_pt(p, p0);
+        }
+        // check wether project p is on the segement
+        if(dot_ab >= 0 && dot_cb >= 0){
+            ds = dot_ab / length;
+            return std::fabs((ax * by - ay * bx) / length);
+        }
+        else if(dot_ab < 0){
+            ds = dot_ab / length;
+            return length_to_pt(p, p0);
+        }
+        else{
+            ds = length - dot_cb / length;
+            return length_to_pt(p, p1);
+        }
+    }
+
+    // angle of front->p and p->back, + if anticlockwise, - otherwise
+    template<typename P>
+    inline double convex(const P& p, const P& front, const P& back)
+    {
+        double fx = p.x - front.x, fy = p.y - front.y;
+        double bx = back.x - p.x, by = back.y - p.y;
+        double sign_tag = (fx * by - fy * bx) < 0 ? -1.0 : 1.0;
+        double cos_value = (fx * bx + fy * by) / (std::sqrt(fx * fx + fy * fy) * std::sqrt(bx * bx + by * by));
+        if(cos_value > 1.0) return 0.0f;
+        if(cos_value < -1.0) return M_PI;
+        return sign_tag * std::acos(cos_value);
+    }
+
+    /**
+     * LINE DISTANCES
+     *
+     * Description:
+     *    dis[i] = length_to_line((x[i], y[i]), (x0, y0), (x1, y1)) of n points in SoA layout,
+     *    with AVX2 when the library is built with ASFIT_SIMD_DISPATCH and the CPU supports it
+     */
+    void line_distances(
+        const double* x, const double* y, size_t n,
+        double x0, double y0, double x1, double y1,
+        double* dis
+    );
+}
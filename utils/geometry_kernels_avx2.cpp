@@ -0,0 +1,44 @@
+// AVX2 bodies of the SoA batch kernels, built with -mavx2 but without -mfma, so every lane
+// rounds as the scalar kernels do and the results are bit-identical.
+#include "geometry_kernels.h"
+
+#if defined(ASFIT_GEOMETRY_AVX2) && defined(__AVX2__)
+#include <immintrin.h>
+
+namespace
+{
+    struct XY
+    {
+        double x;
+        double y;
+    };
+
+    inline __m256d vabs(__m256d v) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), v); }
+}
+
+namespace asfit
+{
+    namespace avx2
+    {
+        void line_distances(const double* x, const double* y, size_t n, double x0, double y0, double x1, double y1, double* dis)
+        {
+            XY p0{x0, y0}, p1{x1, y1};
+            double bx = x1 - x0, by = y1 - y0;
+            double lb = std::sqrt(bx * bx + by * by);
+            size_t i = 0;
+            if(std::fabs(lb) != std::numeric_limits<double>::epsilon()){
+                __m256d vx0 = _mm256_set1_pd(x0), vy0 = _mm256_set1_pd(y0);
+                __m256d vbx = _mm256_set1_pd(bx), vby = _mm256_set1_pd(by);
+                __m256d vlb = _mm256_set1_pd(lb);
+                for(; i + 4 <= n; i += 4){
+                    __m256d ax = _mm256_sub_pd(_mm256_loadu_pd(x + i), vx0);
+                    __m256d ay = _mm256_sub_pd(_mm256_loadu_pd(y + i), vy0);
+                    __m256d c = _mm256_sub_pd(_mm256_mul_pd(ax, vby), _mm256_mul_pd(ay, vbx));
+                    _mm256_storeu_pd(dis + i, vabs(_mm256_div_pd(c, vlb)));
+                }
+            }
+            for(; i < n; i++) dis[i] = length_to_line(XY{x[i], y[i]}, p0, p1);
+        }
+    }
+}
+#endif
@@ -0,0 +1,527 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+#include "param_spline.h"
+
+using namespace asfit;
+
+namespace
+{
+    const char APS_MAGIC[4] = {'A', 'P', 'S', '3'};
+    const uint32_t APS_VERSION = 1;
+    const size_t AXES = 3;
+
+    // 5 point Gauss-Legendre quadrature on [-1, 1]
+    const double GL_NODES[5] = {0.0, -0.5384693101056831, 0.5384693101056831, -0.9061798459386640, 0.9061798459386640};
+    const double GL_WEIGHTS[5] = {0.5688888888888889, 0.4786286704993665, 0.4786286704993665, 0.2369268850561891, 0.2369268850561891};
+
+    // Newton steps of the inverse arc length, the tolerance is relative to the segment length
+    const int NEWTON_ITERATIONS = 20;
+    const double NEWTON_TOLERANCE = 1e-12;
+
+    // segments of a leaf of the box tree, starting parameters of the projection on a segment
+    const size_t LEAF_SEGMENTS = 4;
+    const int PROJECT_STARTS = 5;
+    const int PROJECT_ITERATIONS = 12;
+    // points of a batch projected as one task of the pool
+    const size_t PROJECT_CHUNK = 1024;
+    // values read at once, the buffers only grow with the data actually in the stream
+    const size_t READ_CHUNK = 1 << 16;
+
+    // read cnt doubles into values chunk by chunk, false if the stream ends before
+    bool read_values(std::istream& stream, uint64_t cnt, std::vector<double>& values)
+    {
+        values.clear();
+        while(values.size() < cnt){
+            size_t first = values.size();
+            size_t chunk = size_t(std::min<uint64_t>(READ_CHUNK, cnt - first));
+            values.resize(first + chunk);
+            stream.read(reinterpret_cast<char*>(values.data() + first), chunk * sizeof(double));
+            if(!stream) return false;
+        }
+        return true;
+    }
+
+    // squared distance of (px, py) to the box, 0 inside
+    inline double box_distance2(const double* box, double px, double py)
+    {
+        double dx = std::max(0.0, std::max(box[0] - px, px - box[2]));
+        double dy = std::max(0.0, std::max(box[1] - py, py - box[3]));
+        return dx * dx + dy * dy;
+    }
+
+    // range [lo, hi] of the cubic c0 + c1*u + c2*u^2 + c3*u^3 on [0, h]
+    inline void cubic_range(const double* c, double h, double& lo, double& hi)
+    {
+        auto value = [c](double u){ return c[0] + u * (c[1] + u * (c[2] + u * c[3])); };
+        lo = std::min(value(0.0), value(h));
+        hi = std::max(value(0.0), value(h));
+        // roots of the derivative 3*c3*u^2 + 2*c2*u + c1
+        double a = 3.0 * c[3], b = 2.0 * c[2], k = c[1];
+        double roots[2];
+        int count = 0;
+        if(a == 0.0){
+            if(b != 0.0) roots[count++] = -k / b;
+        }else{
+            double disc = b * b - 4.0 * a * k;
+            if(disc >= 0.0){
+                double q = -0.5 * (b + std::copysign(std::sqrt(disc), b));
+                roots[count++] = q / a;
+                if(q != 0.0) roots[count++] = k / q;
+            }
+        }
+        for(int i = 0; i < count; i++){
+            if(roots[i] > 0.0 && roots[i] < h){
+                lo = std::min(lo, value(roots[i]));
+                hi = std::max(hi, value(roots[i]));
+            }
+        }
+    }
+}
+
+bool ParamSpline3D::build(const PiecewiseCubic& splines)
+{
+    size_t dims = splines.dims();
+    if(dims == AXES){
+        if(!_curve.assign(AXES, splines.knots(), splines.coefficients())) return false;
+        build_arc_length();
+        build_index();
+        return true;
+    }
+    if(dims != AXES - 1) return false;
+
+    // x(t) = t on every segment, u = t - knot
+    const std::vector<double>& knots = splines.knots();
+    const std::vector<double>& c = splines.coefficients();
+    size_t m = knots.size() - 1;
+    std::vector<double>& coefficients = _lifted;
+    coefficients.assign(m * AXES * 4, 0.0);
+    for(size_t l = 0; l < m; l++){
+        double* dst = &coefficients[l * AXES * 4];
+        dst[0] = knots[l];
+        dst[1] = 1.0;
+        std::copy(&c[l * dims * 4], &c[(l + 1) * dims * 4], dst + 4);
+    }
+    if(!_curve.assign(AXES, knots, coefficients)) return false;
+    build_arc_length();
+    build_index();
+    return true;
+}
+
+void ParamSpline3D::clear()
+{
+    _curve = PiecewiseCubic();
+    _arc.clear();
+    _boxes.clear();
+    _nodes.clear();
+}
+
+Point3D ParamSpline3D::eval(double t) const
+{
+    if(empty()) return Point3D();
+
+    const std::vector<double>& x = _curve.knots();
+    size_t l = segment(t);
+    const double* c = &_curve.coefficients()[l * AXES * 4];
+    double u = t - x[l];
+    double v[AXES];
+    for(size_t k = 0; k < AXES; k++, c += 4){
+        v[k] = c[0] + u * (c[1] + u * (c[2] + u * c[3]));
+    }
+    return Point3D(v[0], v[1], v[2]);
+}
+
+bool ParamSpline3D::sample(double density, std::vector<std::vector<double>>& result, bool derivatives, SampleBuffers* buffers) const
+{
+    if(empty()){
+        std::cout << "ERROR.ParamSpline3D::sample(): the spline is empty.\n";
+        return false;
+    }
+    if(!(density > 0.0)){
+        std::cout << "ERROR.ParamSpline3D::sample(): density must be positive.\n";
+        return false;
+    }
+    double t0 = tmin(), t1 = tmax();
+    int cnt = std::max(1, int((t1 - t0) / density));
+    sample(t0, (t1 - t0) / cnt, size_t(cnt) + 1, result, derivatives, buffers);
+    return true;
+}
+
+void ParamSpline3D::sample(
+    double t0, double step, size_t cnt, std::vector<std::vector<double>>& result, bool derivatives, SampleBuffers* buffers) const
+{
+    if(empty()) return;
+    SampleBuffers local;
+    SampleBuffers& scratch = buffers != nullptr ? *buffers : local;
+    append(cnt, result, derivatives, scratch);
+    _curve.calc(t0, step, cnt, scratch.out, derivatives ? &scratch.frame : nullptr);
+}
+
+void ParamSpline3D::sample(
+    const double* t, size_t cnt, std::vector<std::vector<double>>& result, bool derivatives, SampleBuffers* buffers) const
+{
+    if(empty()) return;
+    SampleBuffers local;
+    SampleBuffers& scratch = buffers != nullptr ? *buffers : local;
+    append(cnt, result, derivatives, scratch);
+    _curve.calc(t, cnt, scratch.out, derivatives ? &scratch.frame : nullptr);
+}
+
+bool ParamSpline3D::sample_arc_length(
+    double density, std::vector<std::vector<double>>& result, bool derivatives, SampleBuffers* buffers) const
+{
+    if(empty()){
+        std::cout << "ERROR.ParamSpline3D::sample_arc_length(): the spline is empty.\n";
+        return false;
+    }
+    if(!(density > 0.0)){
+        std::cout << "ERROR.ParamSpline3D::sample_arc_length(): density must be positive.\n";
+        return false;
+    }
+    double total = length();
+    if(!(total > 0.0) || !std::isfinite(total)){
+        std::cout << "ERROR.ParamSpline3D::sample_arc_length(): the curve length is invalid.\n";
+        return false;
+    }
+    size_t cnt = std::max<size_t>(1, size_t(total / density));
+    double step = total / cnt;
+    SampleBuffers local;
+    SampleBuffers& scratch = buffers != nullptr ? *buffers : local;
+
+    // the arc lengths ascend, so the segment cursor only moves forward
+    std::vector<double>& t = scratch.t;
+    t.resize(cnt + 1);
+    t[0] = tmin();
+    size_t l = 0, last = _arc.size() - 2;
+    for(size_t i = 1; i < cnt; i++){
+        double s = i * step;
+        while(l < last && _arc[l + 1] <= s) ++l;
+        t[i] = param_in(l, s);
+    }
+    t[cnt] = tmax();
+    sample(t.data(), t.size(), result, derivatives, &scratch);
+    return true;
+}
+
+double ParamSpline3D::arc_length(double t) const
+{
+    if(empty()) return 0.0;
+    if(t <= tmin()) return 0.0;
+    if(t >= tmax()) return length();
+    size_t l = segment(t);
+    return _arc[l] + integrate(l, _curve.knots()[l], t);
+}
+
+double ParamSpline3D::param_at(double s) const
+{
+    if(empty()) return 0.0;
+    if(s <= 0.0) return tmin();
+    if(s >= length()) return tmax();
+
+    // segment l with _arc[l] <= s < _arc[l + 1]
+    size_t l = std::upper_bound(_arc.begin() + 1, _arc.end() - 1, s) - _arc.begin() - 1;
+    return param_in(l, s);
+}
+
+double ParamSpline3D::param_in(size_t l, double s) const
+{
+    const std::vector<double>& x = _curve.knots();
+    double lo = x[l], hi = x[l + 1];
+    double target = s - _arc[l];
+    double seglen = _arc[l + 1] - _arc[l];
+    double t = lo + (hi - lo) * (target / seglen);
+
+    // Newton steps on arc_length(t) - s, bisection when a step leaves the bracket
+    for(int k = 0; k < NEWTON_ITERATIONS; k++){
+        double f = integrate(l, x[l], t) - target;
+        if(std::fabs(f) <= NEWTON_TOLERANCE * seglen) break;
+        if(f < 0.0) lo = t;
+        else hi = t;
+        double d = speed(l, t);
+        double next = d > 0.0 ? t - f / d : lo;
+        t = next > lo && next < hi ? next : 0.5 * (lo + hi);
+    }
+    return t;
+}
+
+size_t ParamSpline3D::segment(double t) const
+{
+    const std::vector<double>& x = _curve.knots();
+    return std::lower_bound(x.begin() + 1, x.end() - 1, t) - x.begin() - 1;
+}
+
+double ParamSpline3D::speed(size_t l, double t) const
+{
+    const double* c = &_curve.coefficients()[l * AXES * 4];
+    double u = t - _curve.knots()[l];
+    double dx = c[1] + u * (2.0 * c[2] + u * 3.0 * c[3]);
+    double dy = c[5] + u * (2.0 * c[6] + u * 3.0 * c[7]);
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+double ParamSpline3D::integrate(size_t l, double ta, double tb) const
+{
+    double half = 0.5 * (tb - ta), mid = 0.5 * (ta + tb);
+    double sum = 0.0;
+    for(int i = 0; i < 5; i++) sum += GL_WEIGHTS[i] * speed(l, mid + half * GL_NODES[i]);
+    return half * sum;
+}
+
+void ParamSpline3D::build_arc_length()
+{
+    const std::vector<double>& x = _curve.knots();
+    _arc.resize(x.size());
+    _arc[0] = 0.0;
+    for(size_t l = 0; l + 1 < x.size(); l++) _arc[l + 1] = _arc[l] + integrate(l, x[l], x[l + 1]);
+}
+
+bool ParamSpline3D::project(double px, double py, double& s, double& offset, double* t) const
+{
+    if(empty() || _nodes.empty()) return false;
+
+    // branch and bound over the box tree, the nearer child is visited first
+    double best = std::numeric_limits<double>::max();
+    double tbest = tmin();
+    size_t lbest = 0;
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while(top > 0){
+        const BoxNode& node = _nodes[stack[--top]];
+        if(box_distance2(node.box, px, py) >= best) continue;
+        if(node.left < 0){
+            for(size_t l = node.first; l < node.last; l++){
+                if(box_distance2(&_boxes[l * 4], px, py) >= best) continue;
+                double tl = 0.0;
+                double d2 = closest(l, px, py, tl);
+                if(d2 < best){
+                    best = d2;
+                    tbest = tl;
+                    lbest = l;
+                }
+            }
+            continue;
+        }
+        double dl = box_distance2(_nodes[node.left].box, px, py);
+        double dr = box_distance2(_nodes[node.right].box, px, py);
+        stack[top++] = dl < dr ? node.right : node.left;
+        stack[top++] = dl < dr ? node.left : node.right;
+    }
+
+    // side of the curve by the tangent at the closest point
+    const double* c = &_curve.coefficients()[lbest * AXES * 4];
+    double u = tbest - _curve.knots()[lbest];
+    double x = c[0] + u * (c[1] + u * (c[2] + u * c[3]));
+    double y = c[4] + u * (c[5] + u * (c[6] + u * c[7]));
+    double dx = c[1] + u * (2.0 * c[2] + u * 3.0 * c[3]);
+    double dy = c[5] + u * (2.0 * c[6] + u * 3.0 * c[7]);
+    double side = dx * (py - y) - dy * (px - x);
+    s = arc_length(tbest);
+    offset = side < 0.0 ? -std::sqrt(best) : std::sqrt(best);
+    if(t != nullptr) *t = tbest;
+    return true;
+}
+
+bool ParamSpline3D::project(const double* px, const double* py, size_t n, double* s, double* offset, ThreadPool* pool) const
+{
+    if(empty()){
+        std::cout << "ERROR.ParamSpline3D::project(): the spline is empty.\n";
+        return false;
+    }
+    auto task = [&](size_t first, size_t last){
+        for(size_t i = first; i < last; i++) project(px[i], py[i], s[i], offset[i]);
+    };
+    size_t chunks = (n + PROJECT_CHUNK - 1) / PROJECT_CHUNK;
+    if(pool == nullptr || chunks < 2){
+        task(0, n);
+        return true;
+    }
+    pool->run(chunks, [&](size_t c, size_t){ task(c * PROJECT_CHUNK, std::min(n, (c + 1) * PROJECT_CHUNK)); });
+    return true;
+}
+
+double ParamSpline3D::closest(size_t l, double px, double py, double& t) const
+{
+    const double* c = &_curve.coefficients()[l * AXES * 4];
+    double h = _curve.knots()[l + 1] - _curve.knots()[l];
+    auto distance2 = [c, px, py](double u){
+        double x = c[0] + u * (c[1] + u * (c[2] + u * c[3])) - px;
+        double y = c[4] + u * (c[5] + u * (c[6] + u * c[7])) - py;
+        return x * x + y * y;
+    };
+
+    // best of the starting parameters
+    double ubest = 0.0, dbest = distance2(0.0);
+    for(int k = 1; k < PROJECT_STARTS; k++){
+        double u = h * k / (PROJECT_STARTS - 1);
+        double d = distance2(u);
+        if(d < dbest){
+            dbest = d;
+            ubest = u;
+        }
+    }
+
+    // Newton steps on (P(u) - p) . P'(u) = 0, clamped to the segment
+    double u = ubest;
+    for(int k = 0; k < PROJECT_ITERATIONS; k++){
+        double x = c[0] + u * (c[1] + u * (c[2] + u * c[3])) - px;
+        double y = c[4] + u * (c[5] + u * (c[6] + u * c[7])) - py;
+        double dx = c[1] + u * (2.0 * c[2] + u * 3.0 * c[3]);
+        double dy = c[5] + u * (2.0 * c[6] + u * 3.0 * c[7]);
+        double ddx = 2.0 * c[2] + 6.0 * u * c[3];
+        double ddy = 2.0 * c[6] + 6.0 * u * c[7];
+        double f = x * dx + y * dy;
+        double df = dx * dx + dy * dy + x * ddx + y * ddy;
+        if(!(df > 0.0)) break;
+        double next = std::min(h, std::max(0.0, u - f / df));
+        double step = next - u;
+        u = next;
+        if(std::fabs(step) <= NEWTON_TOLERANCE * std::max(1.0, h)) break;
+    }
+    double d = distance2(u);
+    if(d < dbest){
+        dbest = d;
+        ubest = u;
+    }
+    t = _curve.knots()[l] + ubest;
+    return dbest;
+}
+
+void ParamSpline3D::build_index()
+{
+    size_t m = segments();
+    const std::vector<double>& x = _curve.knots();
+    _boxes.resize(m * 4);
+    for(size_t l = 0; l < m; l++){
+        const double* c = &_curve.coefficients()[l * AXES * 4];
+        double h = x[l + 1] - x[l];
+        double* box = &_boxes[l * 4];
+        cubic_range(c, h, box[0], box[2]);
+        cubic_range(c + 4, h, box[1], box[3]);
+    }
+    _nodes.clear();
+    _nodes.reserve(2 * (m / LEAF_SEGMENTS + 1));
+    if(m > 0) build_node(0, m);
+}
+
+int ParamSpline3D::build_node(size_t first, size_t last)
+{
+    int index = int(_nodes.size());
+    _nodes.push_back(BoxNode());
+    if(last - first > LEAF_SEGMENTS){
+        size_t mid = first + (last - first) / 2;
+        int left = build_node(first, mid);
+        int right = build_node(mid, last);
+        _nodes[index].left = left;
+        _nodes[index].right = right;
+    }
+    BoxNode& node = _nodes[index];
+    node.first = first;
+    node.last = last;
+    node.box[0] = node.box[1] = std::numeric_limits<double>::max();
+    node.box[2] = node.box[3] = -std::numeric_limits<double>::max();
+    for(size_t l = first; l < last; l++){
+        const double* box = &_boxes[l * 4];
+        node.box[0] = std::min(node.box[0], box[0]);
+        node.box[1] = std::min(node.box[1], box[1]);
+        node.box[2] = std::max(node.box[2], box[2]);
+        node.box[3] = std::max(node.box[3], box[3]);
+    }
+    return index;
+}
+
+void ParamSpline3D::append(
+    size_t cnt, std::vector<std::vector<double>>& result, bool derivatives, SampleBuffers& buffers) const
+{
+    size_t rows = derivatives ? size_t(ROW_NUM) : AXES;
+    if(result.size() < rows) result.resize(rows);
+    auto grow = [cnt, &result](size_t row){
+        size_t first = result[row].size();
+        result[row].resize(first + cnt);
+        return result[row].data() + first;
+    };
+    buffers.out.resize(AXES);
+    for(size_t k = 0; k < AXES; k++) buffers.out[k] = grow(ROW_X + k);
+    if(derivatives){
+        PiecewiseCubic::Derivatives& frame = buffers.frame;
+        frame.d1.resize(AXES);
+        frame.d2.resize(AXES);
+        for(size_t k = 0; k < AXES; k++){
+            frame.d1[k] = grow(ROW_DX + k);
+            frame.d2[k] = grow(ROW_DDX + k);
+        }
+        frame.heading = grow(ROW_HEADING);
+        frame.curvature = grow(ROW_CURVATURE);
+        frame.x = ROW_X;
+        frame.y = ROW_Y;
+    }
+}
+
+bool ParamSpline3D::write(std::ostream& stream) const
+{
+    if(empty()){
+        std::cout << "ERROR.ParamSpline3D::write(): the spline is empty.\n";
+        return false;
+    }
+    const std::vector<double>& knots = _curve.knots();
+    const std::vector<double>& coefficients = _curve.coefficients();
+    uint64_t n = knots.size();
+    stream.write(APS_MAGIC, sizeof(APS_MAGIC));
+    stream.write(reinterpret_cast<const char*>(&APS_VERSION), sizeof(APS_VERSION));
+    stream.write(reinterpret_cast<const char*>(&n), sizeof(n));
+    stream.write(reinterpret_cast<const char*>(knots.data()), knots.size() * sizeof(double));
+    stream.write(reinterpret_cast<const char*>(coefficients.data()), coefficients.size() * sizeof(double));
+    if(!stream){
+        std::cout << "ERROR.ParamSpline3D::write(): failed to write the spline.\n";
+        return false;
+    }
+    return true;
+}
+
+bool ParamSpline3D::read(std::istream& stream)
+{
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t n = 0;
+    stream.read(magic, sizeof(magic));
+    stream.read(reinterpret_cast<char*>(&version), sizeof(version));
+    stream.read(reinterpret_cast<char*>(&n), sizeof(n));
+    if(!stream || std::memcmp(magic, APS_MAGIC, sizeof(APS_MAGIC)) != 0 || version != APS_VERSION || n < 2 || n > (uint64_t(1) << 32)){
+        std::cout << "ERROR.ParamSpline3D::read(): the data is not a spline.\n";
+        return false;
+    }
+    std::vector<double> knots, coefficients;
+    if(!read_values(stream, n, knots) || !read_values(stream, (n - 1) * AXES * 4, coefficients)
+        || !_curve.assign(AXES, knots, coefficients)){
+        std::cout << "ERROR.ParamSpline3D::read(): the spline data is truncated or invalid.\n";
+        return false;
+    }
+    build_arc_length();
+    build_index();
+    return true;
+}
+
+bool ParamSpline3D::save(const std::string& file_path) const
+{
+    std::ofstream file(file_path, std::ios::binary | std::ios::trunc);
+    if(!file.is_open()){
+        std::cout << "ERROR.ParamSpline3D::save(): unable to open file " << file_path << ".\n";
+        return false;
+    }
+    return write(file);
+}
+
+bool ParamSpline3D::load(const std::string& file_path)
+{
+    std::ifstream file(file_path, std::ios::binary);
+    if(!file.is_open()){
+        std::cout << "ERROR.ParamSpline3D::load(): unable to open file " << file_path << ".\n";
+        return false;
+    }
+    return read(file);
+}
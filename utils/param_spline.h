@@ -0,0 +1,219 @@
+// @Description: Fitted 3D Parameter Spline Model
+// @Time       : 2026/10/20 14:30
+// @Author     : tongjx
+
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+#include "piecewise_cubic.h"
+#include "thread_pool.h"
+
+namespace asfit
+{
+    /* Rows of the sampled curve with derivatives, the derivatives are taken with respect to the parameter t,
+       the heading is atan2(y', x') in radians and the curvature is signed, + if the curve turns anticlockwise. */
+    enum SampleRow { ROW_X, ROW_Y, ROW_Z, ROW_DX, ROW_DY, ROW_DZ, ROW_DDX, ROW_DDY, ROW_DDZ, ROW_HEADING, ROW_CURVATURE, ROW_NUM };
+
+    /**
+     * PARAM SPLINE 3D
+     *
+     * Description:
+     *    the fitted curve (x(t), y(t), z(t)) of AlglibSplineFitting or ConcaveHullParamSplineFitting,
+     *    t is the arc length parameter, or x itself for ASF_NORMAL where x(t) = t.
+     *    The knots and 4 coefficients per segment per axis are kept in one flat array,
+     *    c[(l * 3 + k) * 4 + j] for segment l, axis k, so the curve can be sampled at any
+     *    density or evaluated at any parameter without refitting.
+     *    sample() with the density of an ASF_PARAM fitting gives the same values as its result.
+     *    The arc length of the curve in the x-y plane is tabulated at the knots with 5 point
+     *    Gauss-Legendre quadrature of every segment, sample_arc_length() inverts it with
+     *    safeguarded Newton steps to place the points at equal arc length of the fitted curve.
+     *    project() finds the closest point of the curve in the x-y plane: a binary tree of the
+     *    bounding boxes of the segments is searched branch and bound, and the distance on a
+     *    candidate segment is minimized with Newton steps on its cubic pieces.
+     *    The const members only read the curve, so they can be called concurrently.
+     */
+    class ParamSpline3D
+    {
+    public:
+        /* Scratch of the sampling, buffers passed to repeated samplings keep their memory. */
+        struct SampleBuffers
+        {
+            std::vector<double*> out;               // x, y, z rows of the samples
+            PiecewiseCubic::Derivatives frame;      // derivative rows of the samples
+            std::vector<double> t;                  // parameters of sample_arc_length()
+        };
+
+    public:
+        ParamSpline3D(){}
+        ~ParamSpline3D(){}
+
+    public:
+        /**
+         * BUILD
+         *
+         * Description:
+         *    take the splines of a fitting
+         * Parameters:
+         *    @splines: 3 outputs x, y, z over t, or 2 outputs y, z over t = x
+         * Return:
+         *    true if building success, otherwise return false
+         */
+        bool build(const PiecewiseCubic& splines);
+        // drop the curve
+        void clear();
+
+        bool empty() const { return _curve.dims() == 0; }
+        // parameter range [tmin, tmax] of the curve
+        double tmin() const { return empty() ? 0.0 : _curve.knots().front(); }
+        double tmax() const { return empty() ? 0.0 : _curve.knots().back(); }
+        size_t segments() const { return empty() ? 0 : _curve.knots().size() - 1; }
+        const std::vector<double>& knots() const { return _curve.knots(); }
+        const std::vector<double>& coefficients() const { return _curve.coefficients(); }
+        // arc length in the x-y plane from tmin to tmax
+        double length() const { return _arc.empty() ? 0.0 : _arc.back(); }
+
+    public:
+        /**
+         * EVAL
+         *
+         * Description:
+         *    point of the curve at parameter t, the end polynomials extend the curve outside [tmin, tmax]
+         */
+        Point3D eval(double t) const;
+
+        /**
+         * SAMPLE
+         *
+         * Description:
+         *    append the points every density along the curve, from tmin to tmax, to result,
+         *    the step is shortened so the last point is at tmax
+         * Parameters:
+         *    @density: distance of the samples in units of t
+         *    @result:  [[x], [y], [z]] samples are appended
+         *    @derivatives: false as default, also append the rows up to ROW_CURVATURE of SampleRow,
+         *                  evaluated in the same pass as the points
+         *    @buffers: nullptr as default, scratch of the call, reused by repeated samplings
+         * Return:
+         *    true if sampling success, otherwise return false
+         */
+        bool sample(double density, std::vector<std::vector<double>>& result, bool derivatives = false,
+                    SampleBuffers* buffers = nullptr) const;
+        // append the points at t0 + i * step, i = 0, ..., cnt - 1
+        void sample(double t0, double step, size_t cnt, std::vector<std::vector<double>>& result, bool derivatives = false,
+                    SampleBuffers* buffers = nullptr) const;
+        // append the points at t[0], ..., t[cnt - 1], ascending parameters are the fastest
+        void sample(const double* t, size_t cnt, std::vector<std::vector<double>>& result, bool derivatives = false,
+                    SampleBuffers* buffers = nullptr) const;
+
+        /**
+         * SAMPLE ARC LENGTH
+         *
+         * Description:
+         *    append the points every density of arc length along the curve, from tmin to tmax,
+         *    the step is shortened so the last point is at tmax
+         * Parameters:
+         *    @density: arc length between two points in the x-y plane
+         *    @result:  [[x], [y], [z]] samples are appended
+         *    @derivatives: false as default, the same as sample()
+         *    @buffers: nullptr as default, the same as sample()
+         * Return:
+         *    true if sampling success, otherwise return false
+         */
+        bool sample_arc_length(double density, std::vector<std::vector<double>>& result, bool derivatives = false,
+                               SampleBuffers* buffers = nullptr) const;
+
+        // arc length in the x-y plane from tmin to t, t is clamped to [tmin, tmax]
+        double arc_length(double t) const;
+        // parameter t with arc_length(t) = s, s is clamped to [0, length()]
+        double param_at(double s) const;
+
+        /**
+         * PROJECT
+         *
+         * Description:
+         *    Frenet coordinates of the point (px, py) in the x-y plane, the closest point of the curve
+         *    is at arc length s, offset is the signed distance to it, + on the left of the curve,
+         *    points beyond the ends are measured to the end points
+         * Parameters:
+         *    @px, py:  query point
+         *    @s:       arc length of the closest point in the x-y plane
+         *    @offset:  lateral offset
+         *    @t:       nullptr as default, parameter of the closest point
+         * Return:
+         *    true if projection success, otherwise return false
+         */
+        bool project(double px, double py, double& s, double& offset, double* t = nullptr) const;
+
+        /**
+         * PROJECT
+         *
+         * Description:
+         *    project() of n points, with a pool the points are split into chunks on the workers
+         * Parameters:
+         *    @px, py:  n query points
+         *    @s:       n arc lengths
+         *    @offset:  n lateral offsets
+         *    @pool:    nullptr as default, the points are projected on the calling thread
+         * Return:
+         *    true if projection success, otherwise return false
+         */
+        bool project(const double* px, const double* py, size_t n, double* s, double* offset, ThreadPool* pool = nullptr) const;
+
+    public:
+        /**
+         * WRITE / READ
+         *
+         * Description:
+         *    binary form of the curve: magic "APS3", version, knot number, knots and coefficients
+         *    NOTE: the values are stored in the byte order of the host
+         * Return:
+         *    true if success, otherwise return false
+         */
+        bool write(std::ostream& stream) const;
+        bool read(std::istream& stream);
+        bool save(const std::string& file_path) const;
+        bool load(const std::string& file_path);
+
+    private:
+        // grow the rows of result by cnt values, the new values of x, y, z into buffers.out,
+        // and of the derivative rows into buffers.frame if derivatives
+        void append(size_t cnt, std::vector<std::vector<double>>& result, bool derivatives, SampleBuffers& buffers) const;
+        // segment l with x[l] < t <= x[l + 1], clamped, the same as PiecewiseCubic::calc()
+        size_t segment(double t) const;
+        // parameter of the arc length s on segment l with _arc[l] <= s < _arc[l + 1]
+        double param_in(size_t l, double s) const;
+        // |(x'(t), y'(t))| on segment l
+        double speed(size_t l, double t) const;
+        // arc length of segment l from ta to tb
+        double integrate(size_t l, double ta, double tb) const;
+        // arc length at every knot
+        void build_arc_length();
+        // bounding boxes of the segments and their tree
+        void build_index();
+        int build_node(size_t first, size_t last);
+        // squared distance of (px, py) to segment l at the closest parameter t
+        double closest(size_t l, double px, double py, double& t) const;
+
+    private:
+        /* Node of the box tree, segments [first, last) below it, no children for a leaf. */
+        struct BoxNode
+        {
+            double box[4];  // xmin, ymin, xmax, ymax
+            size_t first;
+            size_t last;
+            int left = -1;
+            int right = -1;
+        };
+
+        PiecewiseCubic _curve;
+        std::vector<double> _arc;       // arc length at the knots
+        std::vector<double> _boxes;     // xmin, ymin, xmax, ymax of every segment
+        std::vector<BoxNode> _nodes;    // box tree, the root is _nodes[0]
+        std::vector<double> _lifted;    // coefficients with x(t) = t of a 2 output fitting
+    };
+}
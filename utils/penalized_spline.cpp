@@ -0,0 +1,835 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <iostream>
+
+#include "penalized_spline.h"
+#include "interpolation.h"
+
+using namespace asfit;
+
+namespace
+{
+    // constants of alglib::spline1dfit
+    const double LAMBDA_REG = 1.0e-10;
+    const double CHOLESKY_REG = 1.0e-14;
+    const double LSQR_EPS = 1000 * std::numeric_limits<double>::epsilon();
+    const int LSQR_MAX_ITS = 10;
+    // basis radius is 2, so a design row touches 4 columns and the normal matrix has bandwidth 3
+    const int ROW_WIDTH = 4;
+    const int BAND_WIDTH = 3;
+    // coarse-to-fine choice of the base function number
+    const size_t COARSE_POINTS = 4096;  // points of the subsample of the coarse levels
+    const int COARSE_MIN_M = 16;        // smaller base function numbers are fitted directly
+    const int COARSE_DIVISOR = 8;       // the first level has 1/8 of the base functions
+    const double MIN_IMPROVEMENT = 0.05; // a finer level must reduce the rms error by 5%
+
+    /* Piecewise cubic kernel, unpacked from a natural alglib cubic spline. */
+    class Kernel
+    {
+    public:
+        void build(const double* xs, const double* ys, int n)
+        {
+            alglib::real_1d_array x, y;
+            alglib::spline1dinterpolant spline;
+            alglib::real_2d_array tbl;
+            alglib::ae_int_t cnt;
+            x.setcontent(n, xs);
+            y.setcontent(n, ys);
+            alglib::spline1dbuildcubic(x, y, n, 2, 0.0, 2, 0.0, spline);
+            alglib::spline1dunpack(spline, cnt, tbl);
+            _x.resize(cnt);
+            _c.resize(4 * (cnt - 1));
+            for(int i = 0; i < cnt - 1; i++){
+                _x[i] = tbl[i][0];
+                _x[i + 1] = tbl[i][1];
+                for(int j = 0; j < 4; j++) _c[4 * i + j] = tbl[i][2 + j];
+            }
+        }
+
+        // same segment search and polynomial form as alglib::spline1ddiff
+        void diff(double t, double& f, double& df, double& d2f) const
+        {
+            int l = 0, r = int(_x.size()) - 1;
+            while(l != r - 1){
+                int mid = (l + r) / 2;
+                if(_x[mid] >= t) r = mid;
+                else l = mid;
+            }
+            const double* c = &_c[4 * l];
+            t = t - _x[l];
+            f = c[0] + t * (c[1] + t * (c[2] + t * c[3]));
+            df = c[1] + 2 * t * c[2] + 3 * t * t * c[3];
+            d2f = 2 * c[2] + 6 * t * c[3];
+        }
+
+    private:
+        std::vector<double> _x;
+        std::vector<double> _c;
+    };
+
+    /* Approximate cardinal basis of alglib::spline1dfit on [0, 1], M >= 4. */
+    class BBasis
+    {
+    public:
+        void init(int m)
+        {
+            _m = m;
+            _delta = 1.0 / (m - 1);
+            double h = _delta;
+            double x0[5] = {-h, 0, h, 2 * h, 3 * h};
+            double y0[5] = {2, 1, 1.0 / 6, 0, 0};
+            _s0.build(x0, y0, 5);
+            double x1[6] = {-h, 0, h, 2 * h, 3 * h, 4 * h};
+            double y1[6] = {-1, 0, 2.0 / 3, 1.0 / 6, 0, 0};
+            _s1.build(x1, y1, 6);
+            double x2[7] = {-3 * h, -2 * h, -h, 0, h, 2 * h, 3 * h};
+            double y2[7] = {0, 0, 1.0 / 12, 2.0 / 6, 1.0 / 12, 0, 0};
+            if(m < 5) std::fill(y2, y2 + 7, 0.0);
+            _s2.build(x2, y2, 7);
+        }
+
+        // value, first and second derivative of the k-th basis function at x
+        void diff(int k, double x, double& f, double& df, double& d2f) const
+        {
+            double sgn = 1.0;
+            if(k > _m - 1 - k){
+                k = _m - 1 - k;
+                x = 1.0 - x;
+                sgn = -1.0;
+            }
+            double y = x - k * _delta;
+            if(y <= -2 * _delta || y >= 2 * _delta){
+                f = df = d2f = 0.0;
+                return;
+            }
+            if(k == 0) _s0.diff(x, f, df, d2f);
+            else if(k == 1) _s1.diff(x, f, df, d2f);
+            else _s2.diff(y, f, df, d2f);
+            df *= sgn;
+        }
+
+        double calc(int k, double x) const { double f, df, d2f; diff(k, x, f, df, d2f); return f; }
+        double diff1(int k, double x) const { double f, df, d2f; diff(k, x, f, df, d2f); return df; }
+        double diff2(int k, double x) const { double f, df, d2f; diff(k, x, f, df, d2f); return d2f; }
+
+    private:
+        int _m = 0;
+        double _delta = 0.0;
+        Kernel _s0, _s1, _s2;
+    };
+
+    /**
+     * Sparse design matrix [D; P; R] of the penalized problem,
+     * D - n data rows, P - m nonlinearity penalty rows, R = LAMBDA_REG * I.
+     * Each row of D and P has at most ROW_WIDTH nonzeros starting at first[row].
+     */
+    struct Design
+    {
+        size_t n = 0;
+        int m = 0;
+        std::vector<int> first;
+        std::vector<int> count;
+        std::vector<double> vals;
+        std::vector<double> ata;   // upper band of A'A, then its Cholesky factor U
+
+        size_t rows() const { return n + 2 * m; }
+
+        // y = A * x
+        void mv(const double* x, double* y) const
+        {
+            for(size_t i = 0; i < n + m; i++){
+                const double* v = &vals[ROW_WIDTH * i];
+                const double* xi = x + first[i];
+                double sum = 0.0;
+                for(int j = 0; j < count[i]; j++) sum += v[j] * xi[j];
+                y[i] = sum;
+            }
+            for(int i = 0; i < m; i++) y[n + m + i] = LAMBDA_REG * x[i];
+        }
+
+        // y = A' * x
+        void mtv(const double* x, double* y) const
+        {
+            for(int i = 0; i < m; i++) y[i] = LAMBDA_REG * x[n + m + i];
+            for(size_t i = 0; i < n + m; i++){
+                const double* v = &vals[ROW_WIDTH * i];
+                double* yi = y + first[i];
+                for(int j = 0; j < count[i]; j++) yi[j] += v[j] * x[i];
+            }
+        }
+
+        double& band(int i, int j) { return ata[(BAND_WIDTH + 1) * i + (j - i)]; }
+        double band(int i, int j) const { return ata[(BAND_WIDTH + 1) * i + (j - i)]; }
+
+        // solve U * x = b in place
+        void trsv_upper(double* x) const
+        {
+            for(int i = m - 1; i >= 0; i--){
+                double v = x[i];
+                for(int j = i + 1; j <= std::min(i + BAND_WIDTH, m - 1); j++) v -= band(i, j) * x[j];
+                x[i] = v / band(i, i);
+            }
+        }
+
+        // solve U' * x = b in place
+        void trsv_lower(double* x) const
+        {
+            for(int i = 0; i < m; i++){
+                double v = x[i];
+                for(int k = std::max(0, i - BAND_WIDTH); k < i; k++) v -= band(k, i) * x[k];
+                x[i] = v / band(i, i);
+            }
+        }
+    };
+
+    /* Add the upper band of R'R of the design rows [r0, r1) to ata. */
+    void accumulate_band(const Design& design, size_t r0, size_t r1, std::vector<double>& ata)
+    {
+        for(size_t r = r0; r < r1; r++){
+            const double* v = &design.vals[ROW_WIDTH * r];
+            int k0 = design.first[r];
+            for(int a = 0; a < design.count[r]; a++){
+                for(int b = a; b < design.count[r]; b++){
+                    ata[(BAND_WIDTH + 1) * (k0 + a) + (b - a)] += v[a] * v[b];
+                }
+            }
+        }
+    }
+
+    /* Upper Cholesky factor of the band ata into design.ata, the diagonal is regularized until it succeeds. */
+    bool cholesky(Design& design, const std::vector<double>& ata)
+    {
+        int m = design.m;
+        double mxata = 0.0;
+        for(int i = 0; i < m; i++) mxata = std::max(mxata, std::fabs(ata[(BAND_WIDTH + 1) * i]));
+        if(mxata == 0.0) mxata = 1.0;
+
+        double creg = CHOLESKY_REG;
+        for(int attempt = 0; attempt < 32; attempt++){
+            design.ata = ata;
+            for(int i = 0; i < m; i++) design.band(i, i) += mxata * creg;
+            bool success = true;
+            for(int i = 0; i < m && success; i++){
+                for(int j = i; j <= std::min(i + BAND_WIDTH, m - 1); j++){
+                    double v = design.band(i, j);
+                    for(int k = std::max(0, j - BAND_WIDTH); k < i; k++) v -= design.band(k, i) * design.band(k, j);
+                    if(j == i){
+                        if(!(v > 0.0)){
+                            success = false;
+                            break;
+                        }
+                        design.band(i, i) = std::sqrt(v);
+                    } else design.band(i, j) = v / design.band(i, i);
+                }
+            }
+            if(success) return true;
+            creg = creg * 10 != 0.0 ? creg * 10 : 1.0e-12;
+        }
+        return false;
+    }
+
+    /* Build A'A in band storage and replace it with its upper Cholesky factor, ata is scratch. */
+    bool factorize(Design& design, std::vector<double>& ata)
+    {
+        int m = design.m;
+        ata.assign((BAND_WIDTH + 1) * m, 0.0);
+        accumulate_band(design, 0, design.n + m, ata);
+        for(int i = 0; i < m; i++) ata[(BAND_WIDTH + 1) * i] += LAMBDA_REG * LAMBDA_REG;
+        return cholesky(design, ata);
+    }
+
+    /**
+     * tr(inv(U'U) * G) for the band G, the band of inv(U'U) is computed from the factor U
+     * by the selected inversion of Takahashi, z is scratch.
+     */
+    double trace_inverse_product(const Design& design, const std::vector<double>& gram, std::vector<double>& z)
+    {
+        int m = design.m;
+        z.assign((BAND_WIDTH + 1) * m, 0.0);
+        auto zat = [&](int i, int j) -> double& { return i <= j ? z[(BAND_WIDTH + 1) * i + (j - i)] : z[(BAND_WIDTH + 1) * j + (i - j)]; };
+        double trace = 0.0;
+        for(int i = m - 1; i >= 0; i--){
+            int last = std::min(i + BAND_WIDTH, m - 1);
+            double uii = design.band(i, i);
+            for(int j = last; j >= i; j--){
+                double v = j == i ? 1.0 / uii : 0.0;
+                for(int k = i + 1; k <= last; k++) v -= design.band(i, k) * zat(k, j);
+                zat(i, j) = v / uii;
+                double g = gram[(BAND_WIDTH + 1) * i + (j - i)];
+                trace += (j == i ? 1.0 : 2.0) * zat(i, j) * g;
+            }
+        }
+        return trace;
+    }
+
+    double norm2(const std::vector<double>& v)
+    {
+        double sum = 0.0;
+        for(auto& item : v) sum += item * item;
+        return std::sqrt(sum);
+    }
+
+    /* Vectors of the LSQR iterations. */
+    struct LsqrBuffers
+    {
+        std::vector<double> u, v, w, y, tmp, av;
+    };
+
+    /**
+     * LSQR of Paige and Saunders for min|A*inv(U)*y - b|, x = inv(U)*y.
+     * With the exact Cholesky factor as preconditioner it stops after a few iterations.
+     * With an initial guess x0 the correction of x0 is solved from the residual b - A*x0.
+     */
+    int lsqr(
+        const Design& design,
+        const std::vector<double>& b,
+        std::vector<double>& x,
+        LsqrBuffers& buffers,
+        const std::vector<double>* x0 = nullptr)
+    {
+        size_t rows = design.rows();
+        int m = design.m;
+        std::vector<double>& u = buffers.u;
+        std::vector<double>& v = buffers.v;
+        std::vector<double>& w = buffers.w;
+        std::vector<double>& y = buffers.y;
+        std::vector<double>& tmp = buffers.tmp;
+        std::vector<double>& av = buffers.av;
+        u.assign(b.begin(), b.end());
+        v.resize(m);
+        w.resize(m);
+        y.assign(m, 0.0);
+        tmp.resize(m);
+        av.resize(rows);
+        if(x0){
+            design.mv(x0->data(), av.data());
+            for(size_t i = 0; i < rows; i++) u[i] -= av[i];
+            x.assign(x0->begin(), x0->end());
+        }else x.assign(m, 0.0);
+
+        double beta = norm2(u);
+        if(beta == 0.0) return 0;
+        for(auto& item : u) item /= beta;
+        design.mtv(u.data(), v.data());
+        design.trsv_lower(v.data());
+        double alpha = norm2(v);
+        if(alpha == 0.0) return 0;
+        for(auto& item : v) item /= alpha;
+        w = v;
+
+        double bnorm = beta, anorm = 0.0, ynorm = 0.0;
+        double phibar = beta, rhobar = alpha;
+        int itn = 0;
+        while(itn < LSQR_MAX_ITS){
+            ++itn;
+            // u = A*inv(U)*v - alpha*u
+            std::copy(v.begin(), v.end(), tmp.begin());
+            design.trsv_upper(tmp.data());
+            design.mv(tmp.data(), av.data());
+            for(size_t i = 0; i < rows; i++) u[i] = av[i] - alpha * u[i];
+            beta = norm2(u);
+            if(beta > 0.0) for(auto& item : u) item /= beta;
+            anorm = std::sqrt(anorm * anorm + alpha * alpha + beta * beta);
+            // v = inv(U')*A'*u - beta*v
+            design.mtv(u.data(), tmp.data());
+            design.trsv_lower(tmp.data());
+            for(int i = 0; i < m; i++) v[i] = tmp[i] - beta * v[i];
+            alpha = norm2(v);
+            if(alpha > 0.0) for(auto& item : v) item /= alpha;
+            // plane rotation
+            double rho = std::sqrt(rhobar * rhobar + beta * beta);
+            double c = rhobar / rho;
+            double s = beta / rho;
+            double theta = s * alpha;
+            rhobar = -c * alpha;
+            double phi = c * phibar;
+            phibar = s * phibar;
+            for(int i = 0; i < m; i++){
+                y[i] += (phi / rho) * w[i];
+                w[i] = v[i] - (theta / rho) * w[i];
+            }
+            // stopping criteria
+            ynorm = norm2(y);
+            double rnorm = phibar;
+            double arnorm = phibar * alpha * std::fabs(c);
+            if(rnorm <= LSQR_EPS * bnorm + LSQR_EPS * anorm * ynorm) break;
+            if(arnorm <= LSQR_EPS * anorm * rnorm) break;
+            if(alpha == 0.0 || beta == 0.0) break;
+        }
+        design.trsv_upper(y.data());
+        if(x0) for(int i = 0; i < m; i++) x[i] += y[i];
+        else x = y;
+        return itn;
+    }
+
+    /**
+     * Direct solve of the normal equations A'A*x = A'b with the Cholesky factor U and one step
+     * of iterative refinement x += inv(U'U)*A'(b - A*x), which also removes the shift of the
+     * diagonal regularization of the factor.
+     */
+    void direct_solve(const Design& design, const std::vector<double>& b, std::vector<double>& x, LsqrBuffers& buffers)
+    {
+        size_t rows = design.rows();
+        int m = design.m;
+        std::vector<double>& r = buffers.u;
+        std::vector<double>& dx = buffers.tmp;
+        std::vector<double>& av = buffers.av;
+        r.resize(rows);
+        dx.resize(m);
+        av.resize(rows);
+        x.resize(m);
+        design.mtv(b.data(), x.data());
+        design.trsv_lower(x.data());
+        design.trsv_upper(x.data());
+        design.mv(x.data(), av.data());
+        for(size_t i = 0; i < rows; i++) r[i] = b[i] - av[i];
+        design.mtv(r.data(), dx.data());
+        design.trsv_lower(dx.data());
+        design.trsv_upper(dx.data());
+        for(int i = 0; i < m; i++) x[i] += dx[i];
+    }
+
+    /* Remove linear trend a*t+b from y, same as alglib buildpriorterm1 with linear model. */
+    void linear_trend(const std::vector<double>& t, std::vector<double>& y, double& a, double& b)
+    {
+        size_t n = t.size();
+        double stt = 0.0, st = 0.0, sty = 0.0, sy = 0.0;
+        for(size_t i = 0; i < n; i++){
+            stt += t[i] * t[i];
+            st += t[i];
+            sty += t[i] * y[i];
+            sy += y[i];
+        }
+        double lambdareg = 0.0;
+        for(;;){
+            double a00 = stt + lambdareg * (stt != 0.0 ? stt : 1.0);
+            double a11 = double(n) + lambdareg * (n != 0 ? double(n) : 1.0);
+            double l00 = a00 > 0.0 ? std::sqrt(a00) : 0.0;
+            double l10 = l00 > 0.0 ? st / l00 : 0.0;
+            double d = a11 - l10 * l10;
+            if(l00 > 0.0 && d > 0.0){
+                double l11 = std::sqrt(d);
+                double z0 = sty / l00;
+                double z1 = (sy - l10 * z0) / l11;
+                b = z1 / l11;
+                a = (z0 - l10 * b) / l00;
+                break;
+            }
+            lambdareg = lambdareg * 10 != 0.0 ? lambdareg * 10 : 1.0e-12;
+        }
+        for(size_t i = 0; i < n; i++) y[i] -= a * t[i] + b;
+    }
+
+    /* Value of the Hermite spline on the uniform knots of [0, 1]. */
+    double hermite_calc(const std::vector<double>& y, const std::vector<double>& d, double t)
+    {
+        int m = int(y.size());
+        int l = int(std::floor(t * (m - 1)));
+        l = std::max(0, std::min(l, m - 2));
+        double x0 = double(l) / (m - 1);
+        double delta = double(l + 1) / (m - 1) - x0;
+        double c2 = (3 * (y[l + 1] - y[l]) - 2 * d[l] * delta - d[l + 1] * delta) / (delta * delta);
+        double c3 = (2 * (y[l] - y[l + 1]) + d[l] * delta + d[l + 1] * delta) / (delta * delta * delta);
+        double dt = t - x0;
+        return y[l] + dt * (d[l] + dt * (c2 + dt * c3));
+    }
+
+    /* Value of a Hermite spline with ascending knots at s, clamped to the first and the last segment. */
+    double hermite_value(const HermiteSpline& spline, double s)
+    {
+        const std::vector<double>& x = spline.x;
+        int l = int(std::upper_bound(x.begin(), x.end(), s) - x.begin()) - 1;
+        l = std::max(0, std::min(l, int(x.size()) - 2));
+        double delta = x[l + 1] - x[l];
+        const std::vector<double>& y = spline.y;
+        const std::vector<double>& d = spline.d;
+        double c2 = (3 * (y[l + 1] - y[l]) - 2 * d[l] * delta - d[l + 1] * delta) / (delta * delta);
+        double c3 = (2 * (y[l] - y[l + 1]) + d[l] * delta + d[l + 1] * delta) / (delta * delta * delta);
+        double dt = s - x[l];
+        return y[l] + dt * (d[l] + dt * (c2 + dt * c3));
+    }
+
+    /**
+     * Coefficients c of the basis with sum(c[i] * B[i](t[j])) = v[j] on the m knots t[j],
+     * a basis function only touches its neighbour knots, so the system is tridiagonal.
+     * v is replaced by c, diag is scratch.
+     */
+    void collocation(const BBasis& basis, int m, std::vector<double>& v, std::vector<double>& diag)
+    {
+        diag.resize(m);
+        // forward elimination of the subdiagonal, diag keeps the eliminated superdiagonal ratios
+        double prev_sup = 0.0;
+        for(int j = 0; j < m; j++){
+            double t = double(j) / (m - 1);
+            double sub = j > 0 ? basis.calc(j - 1, t) : 0.0;
+            double dia = basis.calc(j, t);
+            double sup = j < m - 1 ? basis.calc(j + 1, t) : 0.0;
+            double den = dia - sub * prev_sup;
+            v[j] = (v[j] - (j > 0 ? sub * v[j - 1] : 0.0)) / den;
+            prev_sup = sup / den;
+            diag[j] = prev_sup;
+        }
+        for(int j = m - 2; j >= 0; j--) v[j] -= diag[j] * v[j + 1];
+    }
+}
+
+/* Buffers kept between the fittings of one solver. */
+struct PenalizedSpline::Workspace
+{
+    int basis_m = 0;    // base function number of the cached basis
+    BBasis basis;
+    Design design;
+    LsqrBuffers lsqr;
+    std::vector<double> ata, t, w, y, targets, coeffs, guess, diag, rms;
+    std::vector<double> gram, penalty, rhs, yy, z;  // generalized cross-validation
+};
+
+PenalizedSpline::PenalizedSpline() : _workspace(new Workspace()) {}
+
+PenalizedSpline::~PenalizedSpline() {}
+
+PenalizedSpline::PenalizedSpline(const PenalizedSpline& other)
+    : _lambdans(other._lambdans), _base_function_num(other._base_function_num),
+      _knot_spacing(other._knot_spacing), _max_base_function_num(other._max_base_function_num),
+      _gcv_grid(other._gcv_grid), _gcv_lambdans_min(other._gcv_lambdans_min),
+      _gcv_lambdans_max(other._gcv_lambdans_max), _direct(other._direct), _workspace(new Workspace()) {}
+
+PenalizedSpline& PenalizedSpline::operator=(const PenalizedSpline& other)
+{
+    _lambdans = other._lambdans;
+    _base_function_num = other._base_function_num;
+    _knot_spacing = other._knot_spacing;
+    _max_base_function_num = other._max_base_function_num;
+    _gcv_grid = other._gcv_grid;
+    _gcv_lambdans_min = other._gcv_lambdans_min;
+    _gcv_lambdans_max = other._gcv_lambdans_max;
+    _direct = other._direct;
+    return *this;
+}
+
+bool PenalizedSpline::fitting(
+    const double* s,
+    const std::vector<const double*>& ys,
+    size_t n,
+    std::vector<HermiteSpline>& splines,
+    std::vector<SplineFitReport>& reps,
+    const double* weights)
+{
+    // step 01. check value
+    if(n == 0 || ys.empty()){
+        std::cout << "ERROR.PenalizedSpline::fitting(): empty input.\n";
+        return false;
+    }
+    for(size_t i = 0; i < n; i++){
+        if(!std::isfinite(s[i])){
+            std::cout << "ERROR.PenalizedSpline::fitting(): s contains infinite or NAN values.\n";
+            return false;
+        }
+    }
+    if(weights != nullptr){
+        double sum = 0.0;
+        for(size_t i = 0; i < n; i++){
+            if(!std::isfinite(weights[i]) || weights[i] < 0){
+                std::cout << "ERROR.PenalizedSpline::fitting(): weights contain negative, infinite or NAN values.\n";
+                return false;
+            }
+            sum += weights[i];
+        }
+        if(sum == 0.0){
+            std::cout << "ERROR.PenalizedSpline::fitting(): weights are all zero.\n";
+            return false;
+        }
+    }
+    if(!std::isfinite(_lambdans) || _lambdans < 0){
+        std::cout << "ERROR.PenalizedSpline::fitting(): lambdans is invalid.\n";
+        return false;
+    }
+    if(!std::isfinite(_knot_spacing) || _knot_spacing < 0){
+        std::cout << "ERROR.PenalizedSpline::fitting(): knot_spacing is invalid.\n";
+        return false;
+    }
+    if(_gcv_grid > 0 && !(_gcv_lambdans_min > 0 && _gcv_lambdans_min <= _gcv_lambdans_max && std::isfinite(_gcv_lambdans_max))){
+        std::cout << "ERROR.PenalizedSpline::fitting(): gcv lambdans range is invalid.\n";
+        return false;
+    }
+
+    // step 02. determine interval [xa, xb]
+    double xa = *std::min_element(s, s + n);
+    double xb = *std::max_element(s, s + n);
+    if(xa == xb){
+        double v = xa;
+        xa = v >= 0 ? v / 2 - 1 : v * 2 - 1;
+        xb = v >= 0 ? v * 2 + 1 : v / 2 + 1;
+    }
+    if(_knot_spacing == 0.0){
+        return solve(std::max(int(_base_function_num), 4), s, ys, n, 1, xa, xb, splines, reps, weights, false);
+    }
+
+    // step 03. finest base function number of the knot spacing
+    double cap = std::max(4.0, std::min(_max_base_function_num, 1.0e7));
+    int target = int(std::min(std::ceil((xb - xa) / _knot_spacing) + 1, cap));
+    target = std::max(target, 4);
+    if(target <= COARSE_MIN_M){
+        return solve(target, s, ys, n, 1, xa, xb, splines, reps, weights, false);
+    }
+
+    // step 04. coarse-to-fine on the subsample, stop when a finer level does not help
+    size_t stride = std::max<size_t>(1, n / COARSE_POINTS);
+    std::vector<double>& rms = _workspace->rms;
+    rms.assign(ys.size(), 0.0);
+    int m = std::max(4, (target - 1) / COARSE_DIVISOR + 1);
+    int chosen = m;
+    for(bool first = true; ; first = false){
+        if(!solve(m, s, ys, n, stride, xa, xb, splines, reps, weights, !first)) return false;
+        bool improved = first;
+        for(size_t k = 0; k < ys.size(); k++){
+            if(reps[k].rmserror < (1.0 - MIN_IMPROVEMENT) * rms[k]) improved = true;
+            rms[k] = reps[k].rmserror;
+        }
+        if(!improved) break;
+        chosen = m;
+        if(m >= target) break;
+        m = std::min(target, 2 * m - 1);
+    }
+
+    // step 05. fit all the points with the chosen level, unless they were the subsample
+    //          and the last solved level is the chosen one, a rejected finer level is dropped
+    if(stride == 1 && m == chosen) return true;
+    return solve(chosen, s, ys, n, 1, xa, xb, splines, reps, weights, true);
+}
+
+bool PenalizedSpline::solve(
+    int m,
+    const double* s,
+    const std::vector<const double*>& ys,
+    size_t n,
+    size_t stride,
+    double xa,
+    double xb,
+    std::vector<HermiteSpline>& splines,
+    std::vector<SplineFitReport>& reps,
+    const double* weights,
+    bool warm_start)
+{
+    // step 01. map s into [0, 1], the weights of the points multiply their rows as spline1dfitpenalizedw,
+    //          the unit weights of an unweighted fitting keep the products exact
+    size_t cnt = (n + stride - 1) / stride;
+    double scaletargetsby = 1.0 / std::sqrt(double(cnt));
+    double scalepenaltyby = 1.0 / std::sqrt(double(m));
+    std::vector<double>& t = _workspace->t;
+    std::vector<double>& w = _workspace->w;
+    t.resize(cnt);
+    w.resize(cnt);
+    for(size_t i = 0; i < cnt; i++) t[i] = (s[i * stride] - xa) / (xb - xa);
+    for(size_t i = 0; i < cnt; i++) w[i] = (weights != nullptr ? weights[i * stride] : 1.0) * scaletargetsby;
+
+    // step 02. generate design matrix, shared by all outputs,
+    //          the penalty rows are scaled by lambdans after the cross-validation
+    double lambdans = _gcv_grid > 0 ? 1.0 : _lambdans;
+    BBasis& basis = _workspace->basis;
+    if(_workspace->basis_m != m){
+        basis.init(m);
+        _workspace->basis_m = m;
+    }
+    Design& design = _workspace->design;
+    design.n = cnt;
+    design.m = m;
+    design.first.resize(cnt + m);
+    design.count.resize(cnt + m);
+    design.vals.assign(ROW_WIDTH * (cnt + m), 0.0);
+    for(size_t i = 0; i < cnt; i++){
+        int k = int(std::floor(std::max(0.0, std::min(t[i] * (m - 1), double(m - 1)))));
+        int k0 = std::max(k - 1, 0);
+        int k1 = std::min(k + 2, m - 1);
+        design.first[i] = k0;
+        design.count[i] = k1 - k0 + 1;
+        for(int j = k0; j <= k1; j++){
+            design.vals[ROW_WIDTH * i + j - k0] = basis.calc(j, t[i]) * w[i];
+        }
+    }
+    for(int i = 0; i < m; i++){
+        int k0 = std::max(i - 1, 0);
+        int k1 = std::min(i + 1, m - 1);
+        size_t row = cnt + i;
+        design.first[row] = k0;
+        design.count[row] = k1 - k0 + 1;
+        for(int j = k0; j <= k1; j++){
+            design.vals[ROW_WIDTH * row + j - k0] = basis.diff2(j, double(i) / (m - 1)) * scalepenaltyby * lambdans;
+        }
+    }
+    if(_gcv_grid > 0){
+        lambdans = gcv(ys, stride);
+        for(size_t i = ROW_WIDTH * cnt; i < ROW_WIDTH * (cnt + m); i++) design.vals[i] *= lambdans;
+    }
+
+    // step 03. banded normal equations and Cholesky preconditioner
+    if(!factorize(design, _workspace->ata)){
+        std::cout << "ERROR.PenalizedSpline::fitting(): cholesky factorization failed.\n";
+        return false;
+    }
+
+    // step 04. solve every output with the shared design
+    warm_start = warm_start && splines.size() == ys.size();
+    splines.resize(ys.size());
+    reps.resize(ys.size());
+    std::vector<double>& y = _workspace->y;
+    std::vector<double>& targets = _workspace->targets;
+    std::vector<double>& coeffs = _workspace->coeffs;
+    std::vector<double>& guess = _workspace->guess;
+    y.resize(cnt);
+    targets.assign(design.rows(), 0.0);
+    for(size_t k = 0; k < ys.size(); k++){
+        const double* yk = ys[k];
+        for(size_t i = 0; i < cnt; i++){
+            if(!std::isfinite(yk[i * stride])){
+                std::cout << "ERROR.PenalizedSpline::fitting(): y contains infinite or NAN values.\n";
+                return false;
+            }
+            y[i] = yk[i * stride];
+        }
+        double a = 0.0, b = 0.0;
+        linear_trend(t, y, a, b);
+        for(size_t i = 0; i < cnt; i++) targets[i] = y[i] * w[i];
+        SplineFitReport& rep = reps[k];
+        rep = SplineFitReport();
+        rep.base_function_num = m;
+        rep.lambdans = lambdans;
+
+        // the previous spline without the linear trend, interpolated on the knots
+        HermiteSpline& spline = splines[k];
+        bool guessed = !_direct && warm_start && spline.x.size() >= 2;
+        if(guessed){
+            guess.resize(m);
+            for(int j = 0; j < m; j++){
+                double tj = double(j) / (m - 1);
+                guess[j] = hermite_value(spline, xa + tj * (xb - xa)) - (a * tj + b);
+            }
+            collocation(basis, m, guess, _workspace->diag);
+        }
+        if(_direct) direct_solve(design, targets, coeffs, _workspace->lsqr);
+        else rep.iterations = lsqr(design, targets, coeffs, _workspace->lsqr, guessed ? &guess : nullptr);
+
+        // convert from B-basis to C2-continuous Hermite spline
+        spline.x.resize(m);
+        spline.y.assign(m, 0.0);
+        spline.d.assign(m, 0.0);
+        for(int i = 0; i < m; i++) spline.x[i] = double(i) / (m - 1);
+        for(int i = 0; i < m; i++){
+            for(int j = std::max(i - 1, 0); j <= std::min(i + 1, m - 1); j++){
+                spline.y[j] += coeffs[i] * basis.calc(i, spline.x[j]);
+                spline.d[j] += coeffs[i] * basis.diff1(i, spline.x[j]);
+            }
+        }
+
+        // fitting errors
+        int nrel = 0;
+        rep.terminationtype = 1;
+        for(size_t i = 0; i < cnt; i++){
+            double v = hermite_calc(spline.y, spline.d, t[i]) - y[i];
+            rep.rmserror += v * v;
+            rep.avgerror += std::fabs(v);
+            rep.maxerror = std::max(rep.maxerror, std::fabs(v));
+            if(yk[i * stride] != 0.0){
+                rep.avgrelerror += std::fabs(v / yk[i * stride]);
+                ++nrel;
+            }
+        }
+        rep.rmserror = std::sqrt(rep.rmserror / cnt);
+        rep.avgerror = rep.avgerror / cnt;
+        rep.avgrelerror = rep.avgrelerror / (nrel != 0 ? nrel : 1);
+
+        // append linear trend and transform to original coordinates
+        for(int i = 0; i < m; i++){
+            spline.y[i] += a * spline.x[i] + b;
+            spline.d[i] += a;
+        }
+        for(int i = 0; i < m; i++){
+            spline.x[i] = spline.x[i] * (xb - xa) + xa;
+            spline.d[i] = spline.d[i] / (xb - xa);
+        }
+    }
+    return true;
+}
+
+double PenalizedSpline::gcv(const std::vector<const double*>& ys, size_t stride)
+{
+    Design& design = _workspace->design;
+    int m = design.m;
+    size_t cnt = design.n;
+    size_t outputs = ys.size();
+    size_t bandsize = (BAND_WIDTH + 1) * m;
+
+    // step 01. bands of D'D and P'P, both do not depend on lambdans
+    std::vector<double>& gram = _workspace->gram;
+    std::vector<double>& penalty = _workspace->penalty;
+    gram.assign(bandsize, 0.0);
+    penalty.assign(bandsize, 0.0);
+    accumulate_band(design, 0, cnt, gram);
+    accumulate_band(design, cnt, cnt + m, penalty);
+
+    // step 02. D'y and y'y of every output without its linear trend
+    std::vector<double>& t = _workspace->t;
+    std::vector<double>& w = _workspace->w;
+    std::vector<double>& y = _workspace->y;
+    std::vector<double>& targets = _workspace->targets;
+    std::vector<double>& rhs = _workspace->rhs;
+    std::vector<double>& yy = _workspace->yy;
+    y.resize(cnt);
+    targets.assign(design.rows(), 0.0);
+    rhs.resize(outputs * m);
+    yy.assign(outputs, 0.0);
+    for(size_t k = 0; k < outputs; k++){
+        for(size_t i = 0; i < cnt; i++) y[i] = ys[k][i * stride];
+        double a = 0.0, b = 0.0;
+        linear_trend(t, y, a, b);
+        for(size_t i = 0; i < cnt; i++){
+            targets[i] = y[i] * w[i];
+            yy[k] += targets[i] * targets[i];
+        }
+        design.mtv(targets.data(), &rhs[k * m]);
+    }
+
+    // step 03. minimize GCV = RSS / (1 - tr(H) / n)^2 over the lambdans grid,
+    //          every lambdans only needs the factorization of D'D + lambdans^2 * P'P
+    std::vector<double>& ata = _workspace->ata;
+    std::vector<double>& coeffs = _workspace->coeffs;
+    ata.resize(bandsize);
+    coeffs.resize(m);
+    double best = _lambdans, best_score = std::numeric_limits<double>::infinity();
+    double lmin = std::log(_gcv_lambdans_min), lmax = std::log(_gcv_lambdans_max);
+    for(int g = 0; g < _gcv_grid; g++){
+        double lambdans = std::exp(_gcv_grid > 1 ? lmin + (lmax - lmin) * g / (_gcv_grid - 1) : lmin);
+        for(size_t i = 0; i < bandsize; i++) ata[i] = gram[i] + lambdans * lambdans * penalty[i];
+        for(int i = 0; i < m; i++) ata[(BAND_WIDTH + 1) * i] += LAMBDA_REG * LAMBDA_REG;
+        if(!cholesky(design, ata)) continue;
+
+        // residual of every output from the normal equations, RSS = y'y - 2c'D'y + c'D'Dc
+        double rss = 0.0;
+        for(size_t k = 0; k < outputs; k++){
+            const double* bk = &rhs[k * m];
+            std::copy(bk, bk + m, coeffs.begin());
+            design.trsv_lower(coeffs.data());
+            design.trsv_upper(coeffs.data());
+            double cb = 0.0, cgc = 0.0;
+            for(int i = 0; i < m; i++){
+                cb += coeffs[i] * bk[i];
+                double gc = gram[(BAND_WIDTH + 1) * i] * coeffs[i];
+                for(int j = i + 1; j <= std::min(i + BAND_WIDTH, m - 1); j++){
+                    gc += 2 * gram[(BAND_WIDTH + 1) * i + (j - i)] * coeffs[j];
+                }
+                cgc += coeffs[i] * gc;
+            }
+            rss += std::max(0.0, yy[k] - 2 * cb + cgc);
+        }
+
+        double dof = 1.0 - trace_inverse_product(design, gram, _workspace->z) / double(cnt);
+        if(!(dof > 0.0)) continue;
+        double score = rss / (dof * dof);
+        if(score < best_score){
+            best_score = score;
+            best = lambdans;
+        }
+    }
+    return best;
+}
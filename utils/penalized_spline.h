@@ -0,0 +1,144 @@
+// @Description: Penalized Regression Spline with Shared Design Matrix
+// @Time       : 2026/10/17 09:30
+// @Author     : tongjx
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace asfit
+{
+    /* Fitting report for one output, same fields as alglib::spline1dfitreport. */
+    struct SplineFitReport
+    {
+        int terminationtype = 0;
+        int iterations = 0;       // LSQR iterations, 0 for the direct solve
+        double rmserror = 0.0;
+        double avgerror = 0.0;
+        double avgrelerror = 0.0;
+        double maxerror = 0.0;
+        int base_function_num = 0; // base function number of the fitted spline
+        double lambdans = 0.0;     // nonlinearity penalty of the fitted spline
+    };
+
+    /* Cubic Hermite spline with knots x, values y and first derivatives d. */
+    struct HermiteSpline
+    {
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<double> d;
+    };
+
+    /**
+     * PENALIZED SPLINE
+     *
+     * Description:
+     *    Fitting several outputs [y0], [y1], ... over the same abscissas [s] with the
+     *    penalized regression spline of alglib::spline1dfit.
+     *    The design matrix and the Cholesky factor of its banded normal equations only
+     *    depend on [s], so they are built once and every output is solved against them
+     *    with preconditioned LSQR.
+     *    The basis, the design matrix and the solver vectors are kept by the object,
+     *    repeated fittings with the same base function number do not allocate.
+     *    With a positive knot spacing the base function number is chosen from the length
+     *    of [s]: a coarse-to-fine pass on a subsample doubles it up to length / knot_spacing
+     *    while the rms error still drops, every level starts LSQR from the spline of the
+     *    previous one, and the last level is fitted on all the points.
+     *    Per-point weights scale the rows of the design matrix and the targets in the same
+     *    build, as alglib::spline1dfitpenalizedw, so a weighted fitting costs the same.
+     * Parameters:
+     *    @lambdans: 1e-4 as default, nonlinearity penalty
+     *    @base_function_num: 30 as default, base function number of spline, at least 4
+     *    @knot_spacing: 0 as default, the fixed base_function_num is used, otherwise the
+     *                   finest knot spacing in units of s
+     *    @max_base_function_num: 1000 as default, upper limit of the chosen base function number
+     *    @gcv_grid: 0 as default, the fixed lambdans is used, otherwise lambdans is chosen from
+     *               gcv_grid log-spaced values of [gcv_lambdans_min, gcv_lambdans_max] by the
+     *               generalized cross-validation of all outputs, D'D and P'P are built once
+     *               and every value only refactorizes their banded sum
+     *    @gcv_lambdans_min: 1e-8 as default
+     *    @gcv_lambdans_max: 1e-1 as default
+     *    @direct: false as default, solve the banded normal equations with the Cholesky factor
+     *             and one step of iterative refinement instead of LSQR, for well-conditioned data
+     */
+    class PenalizedSpline
+    {
+    public:
+        PenalizedSpline();
+        ~PenalizedSpline();
+        // copies the parameters only, every object owns its buffers
+        PenalizedSpline(const PenalizedSpline& other);
+        PenalizedSpline& operator=(const PenalizedSpline& other);
+
+    public:
+        double& lambdans(){ return _lambdans; }
+        double& base_function_num() { return _base_function_num; }
+        double& knot_spacing() { return _knot_spacing; }
+        double& max_base_function_num() { return _max_base_function_num; }
+        int& gcv_grid() { return _gcv_grid; }
+        double& gcv_lambdans_min() { return _gcv_lambdans_min; }
+        double& gcv_lambdans_max() { return _gcv_lambdans_max; }
+        bool& direct() { return _direct; }
+
+    public:
+        /**
+         * FITTING
+         *
+         * Description:
+         *    fit one spline for each output in [ys] with the shared abscissas [s]
+         * Parameters:
+         *    @s:       abscissas, n values
+         *    @ys:      outputs, each one points to n values
+         *    @n:       number of points
+         *    @splines: fitted splines, one for each output
+         *    @reps:    fitting reports, one for each output, the errors are not weighted
+         *    @weights: nullptr as default, n non-negative weights, the residual of point i is
+         *              multiplied by weights[i], nullptr fits all the points with weight 1
+         * Return:
+         *    true if fitting success, otherwise return false
+         */
+        bool fitting(
+            const double* s,
+            const std::vector<const double*>& ys,
+            size_t n,
+            std::vector<HermiteSpline>& splines,
+            std::vector<SplineFitReport>& reps,
+            const double* weights = nullptr
+        );
+
+    private:
+        struct Workspace;
+
+        // fit the points s[i * stride] with m base functions on [xa, xb],
+        // the content of splines is the initial guess if warm_start
+        bool solve(
+            int m,
+            const double* s,
+            const std::vector<const double*>& ys,
+            size_t n,
+            size_t stride,
+            double xa,
+            double xb,
+            std::vector<HermiteSpline>& splines,
+            std::vector<SplineFitReport>& reps,
+            const double* weights,
+            bool warm_start
+        );
+        // lambdans of the smallest GCV for the design built with lambdans = 1,
+        // the targets are weighted with the row weights of the design
+        double gcv(const std::vector<const double*>& ys, size_t stride);
+
+    private:
+        double _lambdans = 1e-4;
+        double _base_function_num = 30;
+        double _knot_spacing = 0.0;
+        double _max_base_function_num = 1000;
+        int _gcv_grid = 0;
+        double _gcv_lambdans_min = 1e-8;
+        double _gcv_lambdans_max = 1e-1;
+        bool _direct = false;
+        std::unique_ptr<Workspace> _workspace;
+    };
+}
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "piecewise_cubic.h"
+
+using namespace asfit;
+
+bool PiecewiseCubic::build(const std::vector<HermiteSpline>& splines)
+{
+    if(splines.empty() || splines.front().x.size() < 2) return false;
+    _dims = splines.size();
+    _x = splines.front().x;
+    size_t n = _x.size();
+    for(auto& spline : splines){
+        if(spline.x != _x || spline.y.size() != n || spline.d.size() != n) return false;
+    }
+
+    // same coefficients as alglib::spline1dbuildhermite
+    _c.resize((n - 1) * _dims * 4);
+    for(size_t l = 0; l < n - 1; l++){
+        double delta = _x[l + 1] - _x[l];
+        double delta2 = delta * delta;
+        double delta3 = delta * delta2;
+        for(size_t k = 0; k < _dims; k++){
+            const std::vector<double>& y = splines[k].y;
+            const std::vector<double>& d = splines[k].d;
+            double* c = &_c[(l * _dims + k) * 4];
+            c[0] = y[l];
+            c[1] = d[l];
+            c[2] = (3 * (y[l + 1] - y[l]) - 2 * d[l] * delta - d[l + 1] * delta) / delta2;
+            c[3] = (2 * (y[l] - y[l + 1]) + d[l] * delta + d[l + 1] * delta) / delta3;
+        }
+    }
+    return true;
+}
+
+bool PiecewiseCubic::assign(size_t dims, const std::vector<double>& knots, const std::vector<double>& coefficients)
+{
+    if(dims == 0 || knots.size() < 2 || coefficients.size() != (knots.size() - 1) * dims * 4) return false;
+    for(size_t l = 0; l + 1 < knots.size(); l++){
+        if(!(knots[l] < knots[l + 1])) return false;
+    }
+    _dims = dims;
+    _x.assign(knots.begin(), knots.end());
+    _c.assign(coefficients.begin(), coefficients.end());
+    return true;
+}
+
+size_t PiecewiseCubic::locate(double t) const
+{
+    size_t l = 0, r = _x.size() - 1;
+    while(l != r - 1){
+        size_t mid = (l + r) / 2;
+        if(_x[mid] >= t) r = mid;
+        else l = mid;
+    }
+    return l;
+}
+
+size_t PiecewiseCubic::advance(size_t l, double t) const
+{
+    size_t last = _x.size() - 2;
+    while(l < last && _x[l + 1] < t) ++l;
+    return l;
+}
+
+template<typename Param>
+void PiecewiseCubic::calc_derivatives(const Param& param, size_t i0, size_t i1, size_t l, const Derivatives& derivatives) const
+{
+    double xl = _x[l];
+    for(size_t k = 0; k < _dims; k++){
+        double* o1 = k < derivatives.d1.size() ? derivatives.d1[k] : nullptr;
+        double* o2 = k < derivatives.d2.size() ? derivatives.d2[k] : nullptr;
+        const double* c = &_c[(l * _dims + k) * 4];
+        double c1 = c[1], c2 = 2.0 * c[2], c3 = 3.0 * c[3];
+        if(o1 != nullptr){
+            for(size_t i = i0; i < i1; i++){
+                double u = param(i) - xl;
+                o1[i] = c1 + u * (c2 + u * c3);
+            }
+        }
+        if(o2 != nullptr){
+            for(size_t i = i0; i < i1; i++){
+                double u = param(i) - xl;
+                o2[i] = c2 + 2.0 * u * c3;
+            }
+        }
+    }
+
+    // heading and curvature of the plane curve, x' = 1 and x'' = 0 if x is the parameter
+    if(derivatives.heading == nullptr && derivatives.curvature == nullptr) return;
+    static const double IDENTITY[4] = {0.0, 1.0, 0.0, 0.0};
+    const double* cx = derivatives.x < 0 ? IDENTITY : &_c[(l * _dims + derivatives.x) * 4];
+    const double* cy = &_c[(l * _dims + derivatives.y) * 4];
+    for(size_t i = i0; i < i1; i++){
+        double u = param(i) - xl;
+        double dx = cx[1] + u * (2.0 * cx[2] + u * 3.0 * cx[3]);
+        double dy = cy[1] + u * (2.0 * cy[2] + u * 3.0 * cy[3]);
+        double ddx = 2.0 * cx[2] + 6.0 * u * cx[3];
+        double ddy = 2.0 * cy[2] + 6.0 * u * cy[3];
+        double v2 = dx * dx + dy * dy;
+        if(derivatives.heading != nullptr) derivatives.heading[i] = std::atan2(dy, dx);
+        if(derivatives.curvature != nullptr) derivatives.curvature[i] = v2 > 0.0 ? (dx * ddy - dy * ddx) / (v2 * std::sqrt(v2)) : 0.0;
+    }
+}
+
+template<typename Param>
+void PiecewiseCubic::calc_runs(const Param& param, size_t cnt, const std::vector<double*>& out, const Derivatives* derivatives) const
+{
+    if(_x.empty() || cnt == 0) return;
+    size_t last = _x.size() - 2;
+    size_t l = locate(param(0));
+    size_t i0 = 0;
+    while(i0 < cnt){
+        // the run [i0, i1) of ascending parameters inside segment l
+        size_t i1 = i0 + 1;
+        double prev = param(i0);
+        while(i1 < cnt){
+            double t = param(i1);
+            if(t < prev || (l < last && t > _x[l + 1])) break;
+            prev = t;
+            ++i1;
+        }
+
+        // Horner kernel over the run
+        double xl = _x[l];
+        for(size_t k = 0; k < _dims; k++){
+            double* o = out[k];
+            if(o == nullptr) continue;
+            const double* c = &_c[(l * _dims + k) * 4];
+            double c0 = c[0], c1 = c[1], c2 = c[2], c3 = c[3];
+            for(size_t i = i0; i < i1; i++){
+                double u = param(i) - xl;
+                o[i] = c0 + u * (c1 + u * (c2 + u * c3));
+            }
+        }
+        if(derivatives != nullptr) calc_derivatives(param, i0, i1, l, *derivatives);
+        if(i1 < cnt){
+            double t = param(i1);
+            l = t >= param(i1 - 1) ? advance(l, t) : locate(t);
+        }
+        i0 = i1;
+    }
+}
+
+void PiecewiseCubic::calc(double t0, double step, size_t cnt, const std::vector<double*>& out, const Derivatives* derivatives) const
+{
+    calc_runs([t0, step](size_t i){ return t0 + i * step; }, cnt, out, derivatives);
+}
+
+void PiecewiseCubic::calc(const double* t, size_t cnt, const std::vector<double*>& out, const Derivatives* derivatives) const
+{
+    calc_runs([t](size_t i){ return t[i]; }, cnt, out, derivatives);
+}
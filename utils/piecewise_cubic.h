@@ -0,0 +1,102 @@
+// @Description: Batch Evaluation of Piecewise Cubic Splines
+// @Time       : 2026/10/18 10:05
+// @Author     : tongjx
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "penalized_spline.h"
+
+namespace asfit
+{
+    /**
+     * PIECEWISE CUBIC
+     *
+     * Description:
+     *    splines of several outputs on shared knots in coefficient form,
+     *    S(t) = c0 + c1*u + c2*u^2 + c3*u^3 with u = t - x[l] on the segment l,
+     *    values are the same as alglib::spline1dcalc of the Hermite splines.
+     *    Sorted parameters are evaluated with a cursor walking the knots instead of
+     *    a binary search, and every run of parameters inside one segment is evaluated
+     *    with a Horner loop the compiler can vectorize.
+     *    The derivatives, the heading and the curvature are evaluated in the same run
+     *    from the coefficients of the segment.
+     */
+    class PiecewiseCubic
+    {
+    public:
+        /* Optional outputs of calc(), every buffer receives cnt values, nullptr skips it. */
+        struct Derivatives
+        {
+            std::vector<double*> d1;        // first derivative of every output
+            std::vector<double*> d2;        // second derivative of every output
+            double* heading = nullptr;      // atan2(y', x') of the plane curve (x, y) in radians
+            double* curvature = nullptr;    // signed curvature (x'y'' - y'x'') / (x'^2 + y'^2)^1.5, + if anticlockwise
+            int x = 0;                      // output of the plane x, -1 for the parameter itself
+            int y = 1;                      // output of the plane y
+        };
+
+    public:
+        PiecewiseCubic(){}
+        ~PiecewiseCubic(){}
+
+    public:
+        // build from Hermite splines, all of them MUST share the same knots
+        bool build(const std::vector<HermiteSpline>& splines);
+        // copy knots and coefficients in the layout of coefficients(), e.g. read from a file,
+        // into the buffers of the object
+        bool assign(size_t dims, const std::vector<double>& knots, const std::vector<double>& coefficients);
+        size_t dims() const { return _dims; }
+        const std::vector<double>& knots() const { return _x; }
+        // c[(l * dims + k) * 4 + j] is the coefficient j of output k on segment l
+        const std::vector<double>& coefficients() const { return _c; }
+
+    public:
+        /**
+         * CALC
+         *
+         * Description:
+         *    evaluate every output at the arithmetic sequence t0 + i * step, i = 0, ..., cnt - 1
+         * Parameters:
+         *    @t0:   first parameter
+         *    @step: step of the sequence
+         *    @cnt:  number of parameters
+         *    @out:  dims() buffers, out[k] receives cnt values of output k, nullptr skips the output
+         *    @derivatives: nullptr as default, derivatives, heading and curvature of the same parameters
+         */
+        void calc(double t0, double step, size_t cnt, const std::vector<double*>& out, const Derivatives* derivatives = nullptr) const;
+
+        /**
+         * CALC
+         *
+         * Description:
+         *    evaluate every output at the parameters t[0], ..., t[cnt - 1],
+         *    ascending parameters walk the knots, others fall back to binary search
+         * Parameters:
+         *    @t:    parameters
+         *    @cnt:  number of parameters
+         *    @out:  dims() buffers, out[k] receives cnt values of output k, nullptr skips the output
+         *    @derivatives: nullptr as default, derivatives, heading and curvature of the same parameters
+         */
+        void calc(const double* t, size_t cnt, const std::vector<double*>& out, const Derivatives* derivatives = nullptr) const;
+
+    private:
+        // segment l with x[l] < t <= x[l + 1], clamped to the first and the last segment
+        size_t locate(double t) const;
+        // move the cursor l forward to the segment of t
+        size_t advance(size_t l, double t) const;
+        // derivatives, heading and curvature of the run [i0, i1) inside segment l
+        template<typename Param>
+        void calc_derivatives(const Param& param, size_t i0, size_t i1, size_t l, const Derivatives& derivatives) const;
+        // evaluate param(0), ..., param(cnt - 1) run by run
+        template<typename Param>
+        void calc_runs(const Param& param, size_t cnt, const std::vector<double*>& out, const Derivatives* derivatives) const;
+
+    private:
+        size_t _dims = 0;
+        std::vector<double> _x;  // knots
+        std::vector<double> _c;  // coefficients, c[(l * dims + k) * 4 + j] for segment l, output k
+    };
+}
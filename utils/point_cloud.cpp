@@ -0,0 +1,87 @@
+#include <stdexcept>
+
+#include "point_cloud.h"
+
+using namespace asfit;
+
+/* Gather the values of src by order, empty arrays stay empty. */
+inline void gather_array(const std::vector<double>& src, const std::vector<size_t>& order, std::vector<double>& dst)
+{
+    dst.clear();
+    if(src.empty()) return;
+    dst.reserve(order.size());
+    for(auto& i : order) dst.push_back(src[i]);
+}
+
+void PointCloud::reserve(size_t n)
+{
+    x.reserve(n);
+    y.reserve(n);
+    z.reserve(n);
+    s.reserve(n);
+    for(auto& item : _channels) item.second.reserve(n);
+}
+
+void PointCloud::resize(size_t n)
+{
+    x.resize(n);
+    y.resize(n);
+    if(!z.empty()) z.resize(n);
+    if(!s.empty()) s.resize(n);
+    for(auto& item : _channels) item.second.resize(n);
+}
+
+void PointCloud::clear()
+{
+    x.clear();
+    y.clear();
+    z.clear();
+    s.clear();
+    _channels.clear();
+}
+
+bool PointCloud::has_channel(const std::string& name) const
+{
+    for(auto& item : _channels){
+        if(item.first == name) return true;
+    }
+    return false;
+}
+
+std::vector<std::string> PointCloud::channel_names() const
+{
+    std::vector<std::string> names;
+    names.reserve(_channels.size());
+    for(auto& item : _channels) names.push_back(item.first);
+    return names;
+}
+
+std::vector<double>& PointCloud::channel(const std::string& name)
+{
+    for(auto& item : _channels){
+        if(item.first == name) return item.second;
+    }
+    _channels.emplace_back(name, std::vector<double>(size(), 0.0));
+    return _channels.back().second;
+}
+
+const std::vector<double>& PointCloud::channel(const std::string& name) const
+{
+    for(auto& item : _channels){
+        if(item.first == name) return item.second;
+    }
+    throw std::out_of_range("PointCloud::channel(): no channel " + name);
+}
+
+void PointCloud::gather(const std::vector<size_t>& order, PointCloud& out) const
+{
+    gather_array(x, order, out.x);
+    gather_array(y, order, out.y);
+    gather_array(z, order, out.z);
+    gather_array(s, order, out.s);
+    out._channels.clear();
+    for(auto& item : _channels){
+        out._channels.emplace_back(item.first, std::vector<double>());
+        gather_array(item.second, order, out._channels.back().second);
+    }
+}
@@ -0,0 +1,60 @@
+// @Description: Point Cloud with Structure-of-Arrays Layout
+// @Time       : 2026/10/17 14:20
+// @Author     : tongjx
+
+#pragma once
+
+#include <list>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "geometry.h"
+
+namespace asfit
+{
+    /**
+     * POINT CLOUD
+     *
+     * Description:
+     *    point cloud stored as one array per coordinate instead of one object per point,
+     *    [x], [y], [z] and parameter [s] are fixed members, other values of the points
+     *    (angle, intensity, ...) live in named channels with the same size
+     *    NOTE: z and s may be left empty by the stages which do not need them
+     */
+    class PointCloud
+    {
+    public:
+        PointCloud(){}
+        ~PointCloud(){}
+
+    public:
+        size_t size() const { return x.size(); }
+        bool empty() const { return x.empty(); }
+        void reserve(size_t n);
+        void resize(size_t n);
+        void clear();
+        Point point(size_t i) const { return Point(x[i], y[i]); }
+
+    public:
+        bool has_channel(const std::string& name) const;
+        // names of the channels in creation order
+        std::vector<std::string> channel_names() const;
+        // get the channel, a zero filled channel is created if not exists,
+        // the reference stays valid when other channels are created
+        std::vector<double>& channel(const std::string& name);
+        // get the channel, throw std::out_of_range if not exists
+        const std::vector<double>& channel(const std::string& name) const;
+        // new cloud with the points order[0], order[1], ... of this cloud, out must be another cloud
+        void gather(const std::vector<size_t>& order, PointCloud& out) const;
+
+    public:
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<double> z;
+        std::vector<double> s;
+
+    private:
+        std::list<std::pair<std::string, std::vector<double>>> _channels;
+    };
+}
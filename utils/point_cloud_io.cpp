@@ -0,0 +1,435 @@
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "point_cloud_io.h"
+#include "thread_pool.h"
+
+using namespace asfit;
+
+namespace asfit
+{
+    /* Read-only mapping of a whole file. */
+    class MappedFile
+    {
+    public:
+        ~MappedFile()
+        {
+            if(_data != nullptr) munmap(const_cast<char*>(_data), _size);
+            if(_fd >= 0) close(_fd);
+        }
+
+        bool open(const std::string& file_path)
+        {
+            _fd = ::open(file_path.c_str(), O_RDONLY);
+            if(_fd < 0) return false;
+            struct stat st;
+            if(fstat(_fd, &st) != 0) return false;
+            _size = size_t(st.st_size);
+            if(_size == 0) return true;
+            void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+            if(data == MAP_FAILED) return false;
+            madvise(data, _size, MADV_SEQUENTIAL);
+            _data = static_cast<const char*>(data);
+            return true;
+        }
+
+        const char* data() const { return _data; }
+        size_t size() const { return _size; }
+
+    private:
+        int _fd = -1;
+        const char* _data = nullptr;
+        size_t _size = 0;
+    };
+}
+
+namespace
+{
+    // files smaller than this are parsed by one chunk
+    const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+    // binary columnar format
+    const char PCB_MAGIC[4] = {'A', 'P', 'C', 'B'};
+    const uint32_t PCB_VERSION = 1;
+    const size_t PCB_ALIGNMENT = 64;
+    const size_t PCB_NAME_SIZE = 24;
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t count;
+        uint32_t columns;
+        uint32_t chunk_size;
+        uint64_t chunks_offset;
+        double bbox[6];
+    };
+
+    struct ColumnHeader
+    {
+        char name[PCB_NAME_SIZE];
+        uint32_t type;
+        uint32_t reserved;
+        uint64_t offset;
+    };
+
+    inline size_t align(size_t offset) { return (offset + PCB_ALIGNMENT - 1) / PCB_ALIGNMENT * PCB_ALIGNMENT; }
+    inline size_t type_width(uint32_t type) { return type == PCB_FLOAT32 ? sizeof(float) : sizeof(double); }
+
+    /* Bounding box of the points [first, first + count), z is 0 if empty. */
+    void bounding_box(const PointCloud& cloud, size_t first, size_t count, double* min, double* max)
+    {
+        const std::vector<double>* coords[3] = {&cloud.x, &cloud.y, &cloud.z};
+        for(size_t k = 0; k < 3; k++){
+            min[k] = max[k] = 0.0;
+            const std::vector<double>& values = *coords[k];
+            if(values.empty() || count == 0) continue;
+            auto range = std::minmax_element(values.begin() + first, values.begin() + first + count);
+            min[k] = *range.first;
+            max[k] = *range.second;
+        }
+    }
+
+    inline bool is_separator(char c) { return c == ' ' || c == '\t' || c == ',' || c == '\r'; }
+
+    /* Parse the numbers of [p, end) into values, false if a column is not a number. */
+    inline bool parse_line(const char* p, const char* end, double* values, size_t max_cnt, size_t& cnt)
+    {
+        cnt = 0;
+        for(;;){
+            while(p < end && is_separator(*p)) ++p;
+            if(p == end) return true;
+            if(*p == '+') ++p;
+            double value = 0.0;
+            std::from_chars_result res = std::from_chars(p, end, value);
+            if(res.ec != std::errc() || (res.ptr < end && !is_separator(*res.ptr))) return false;
+            if(cnt < max_cnt) values[cnt] = value;
+            ++cnt;
+            p = res.ptr;
+        }
+    }
+
+    /* Lines of one chunk, written into the rows [offset, offset + capacity) of the cloud. */
+    struct Chunk
+    {
+        const char* begin = nullptr;
+        const char* end = nullptr;
+        size_t offset = 0;
+        size_t capacity = 0;
+        size_t count = 0;
+    };
+
+    void parse_chunk(Chunk& chunk, std::vector<double*>& columns)
+    {
+        size_t ncols = columns.size();
+        std::vector<double> values(ncols);
+        size_t row = chunk.offset;
+        const char* p = chunk.begin;
+        while(p < chunk.end){
+            const char* line_end = static_cast<const char*>(std::memchr(p, '\n', chunk.end - p));
+            if(line_end == nullptr) line_end = chunk.end;
+            size_t cnt = 0;
+            if(parse_line(p, line_end, values.data(), ncols, cnt) && cnt >= 3){
+                for(size_t k = 0; k < ncols; k++){
+                    if(columns[k] != nullptr) columns[k][row] = k < cnt ? values[k] : 0.0;
+                }
+                ++row;
+            }
+            p = line_end + 1;
+        }
+        chunk.count = row - chunk.offset;
+    }
+}
+
+bool asfit::read_xyz(
+    const std::string& file_path,
+    PointCloud& cloud,
+    const std::vector<std::string>& columns,
+    size_t workers)
+{
+    // step 01. map the file
+    MappedFile file;
+    if(!file.open(file_path)){
+        std::cout << "ERROR.read_xyz(): unable to open file " << file_path << ".\n";
+        return false;
+    }
+    cloud.clear();
+    for(auto& name : columns) cloud.channel(name);
+    if(file.size() == 0) return true;
+
+    // step 02. split into chunks at line breaks and count their lines
+    ThreadPool pool(file.size() < 2 * MIN_CHUNK_BYTES ? 1 : workers);
+    size_t nchunks = std::max<size_t>(1, std::min(pool.workers() * 4, file.size() / MIN_CHUNK_BYTES));
+    const char* data = file.data();
+    const char* data_end = data + file.size();
+    std::vector<Chunk> chunks(nchunks);
+    for(size_t i = 0; i < nchunks; i++){
+        const char* begin = i == 0 ? data : chunks[i - 1].end;
+        const char* end = data + file.size() * (i + 1) / nchunks;
+        if(end < begin) end = begin;
+        if(i + 1 == nchunks) end = data_end;
+        else {
+            const char* line_end = static_cast<const char*>(std::memchr(end, '\n', data_end - end));
+            end = line_end == nullptr ? data_end : line_end + 1;
+        }
+        chunks[i].begin = begin;
+        chunks[i].end = end;
+    }
+    pool.run(nchunks, [&](size_t i, size_t){
+        Chunk& chunk = chunks[i];
+        chunk.capacity = std::count(chunk.begin, chunk.end, '\n') + 1;
+    });
+    size_t capacity = 0;
+    for(auto& chunk : chunks){
+        chunk.offset = capacity;
+        capacity += chunk.capacity;
+    }
+
+    // step 03. parse the chunks in place
+    cloud.x.resize(capacity);
+    cloud.y.resize(capacity);
+    cloud.z.resize(capacity);
+    std::vector<double*> outputs = {cloud.x.data(), cloud.y.data(), cloud.z.data()};
+    for(auto& name : columns){
+        std::vector<double>& channel = cloud.channel(name);
+        channel.resize(capacity);
+        outputs.push_back(channel.data());
+    }
+    pool.run(nchunks, [&](size_t i, size_t){
+        std::vector<double*> local(outputs);
+        parse_chunk(chunks[i], local);
+    });
+
+    // step 04. close the gaps left by skipped lines
+    size_t size = 0;
+    for(auto& chunk : chunks){
+        if(chunk.offset != size){
+            for(auto& column : outputs){
+                std::memmove(column + size, column + chunk.offset, chunk.count * sizeof(double));
+            }
+        }
+        size += chunk.count;
+    }
+    cloud.resize(size);
+    return true;
+}
+
+bool asfit::write_pcb(
+    const std::string& file_path,
+    const PointCloud& cloud,
+    bool float32_channels,
+    size_t chunk_size)
+{
+    // step 01. collect the columns
+    size_t n = cloud.size();
+    std::vector<std::pair<std::string, const std::vector<double>*>> columns = {{"x", &cloud.x}, {"y", &cloud.y}};
+    if(!cloud.z.empty()) columns.push_back({"z", &cloud.z});
+    if(!cloud.s.empty()) columns.push_back({"s", &cloud.s});
+    size_t coords = columns.size();
+    for(auto& name : cloud.channel_names()) columns.push_back({name, &cloud.channel(name)});
+    for(auto& column : columns){
+        if(column.first.size() >= PCB_NAME_SIZE || column.second->size() != n){
+            std::cout << "ERROR.write_pcb(): column " << column.first << " is invalid.\n";
+            return false;
+        }
+    }
+    if(chunk_size > std::numeric_limits<uint32_t>::max()){
+        std::cout << "ERROR.write_pcb(): chunk size " << chunk_size << " is larger than the file format allows.\n";
+        return false;
+    }
+
+    // step 02. layout: header, column table, columns, chunk index
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, PCB_MAGIC, sizeof(PCB_MAGIC));
+    header.version = PCB_VERSION;
+    header.count = n;
+    header.columns = uint32_t(columns.size());
+    header.chunk_size = uint32_t(chunk_size);
+    bounding_box(cloud, 0, n, header.bbox, header.bbox + 3);
+    std::vector<ColumnHeader> table(columns.size());
+    size_t offset = align(sizeof(FileHeader) + table.size() * sizeof(ColumnHeader));
+    for(size_t k = 0; k < columns.size(); k++){
+        std::memset(&table[k], 0, sizeof(ColumnHeader));
+        std::memcpy(table[k].name, columns[k].first.data(), columns[k].first.size());
+        table[k].type = float32_channels && k >= coords ? PCB_FLOAT32 : PCB_FLOAT64;
+        table[k].offset = offset;
+        offset = align(offset + n * type_width(table[k].type));
+    }
+    std::vector<double> chunk_boxes;
+    if(chunk_size != 0){
+        header.chunks_offset = offset;
+        for(size_t first = 0; first < n; first += chunk_size){
+            double box[6];
+            bounding_box(cloud, first, std::min(chunk_size, n - first), box, box + 3);
+            chunk_boxes.insert(chunk_boxes.end(), box, box + 6);
+        }
+    }
+
+    // step 03. write the file
+    std::ofstream file(file_path, std::ios::binary | std::ios::trunc);
+    if(!file.is_open()){
+        std::cout << "ERROR.write_pcb(): unable to open file " << file_path << ".\n";
+        return false;
+    }
+    const char zeros[PCB_ALIGNMENT] = {0};
+    auto pad_to = [&](size_t target){
+        size_t pos = size_t(file.tellp());
+        if(target > pos) file.write(zeros, target - pos);
+    };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(ColumnHeader));
+    std::vector<float> narrowed;
+    for(size_t k = 0; k < columns.size(); k++){
+        pad_to(table[k].offset);
+        const std::vector<double>& values = *columns[k].second;
+        if(table[k].type == PCB_FLOAT32){
+            narrowed.assign(values.begin(), values.end());
+            file.write(reinterpret_cast<const char*>(narrowed.data()), n * sizeof(float));
+        }else{
+            file.write(reinterpret_cast<const char*>(values.data()), n * sizeof(double));
+        }
+    }
+    if(chunk_size != 0){
+        pad_to(header.chunks_offset);
+        file.write(reinterpret_cast<const char*>(chunk_boxes.data()), chunk_boxes.size() * sizeof(double));
+    }
+    if(!file.good()){
+        std::cout << "ERROR.write_pcb(): failed to write file " << file_path << ".\n";
+        return false;
+    }
+    return true;
+}
+
+MappedPointCloud::MappedPointCloud(){}
+
+MappedPointCloud::~MappedPointCloud(){}
+
+bool MappedPointCloud::open(const std::string& file_path)
+{
+    // step 01. map the file and check the header
+    close();
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    if(!file->open(file_path)){
+        std::cout << "ERROR.MappedPointCloud::open(): unable to open file " << file_path << ".\n";
+        return false;
+    }
+    const char* data = file->data();
+    size_t size = file->size();
+    FileHeader header;
+    if(size < sizeof(FileHeader)){
+        std::cout << "ERROR.MappedPointCloud::open(): " << file_path << " is not a pcb file.\n";
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if(std::memcmp(header.magic, PCB_MAGIC, sizeof(PCB_MAGIC)) != 0 || header.version != PCB_VERSION){
+        std::cout << "ERROR.MappedPointCloud::open(): " << file_path << " is not a pcb file.\n";
+        return false;
+    }
+
+    // step 02. check the columns
+    size_t n = header.count;
+    if(sizeof(FileHeader) + size_t(header.columns) * sizeof(ColumnHeader) > size){
+        std::cout << "ERROR.MappedPointCloud::open(): column table of " << file_path << " is truncated.\n";
+        return false;
+    }
+    std::vector<Column> columns(header.columns);
+    for(size_t k = 0; k < columns.size(); k++){
+        ColumnHeader item;
+        std::memcpy(&item, data + sizeof(FileHeader) + k * sizeof(ColumnHeader), sizeof(item));
+        if((item.type != PCB_FLOAT64 && item.type != PCB_FLOAT32) || item.offset % PCB_ALIGNMENT != 0 ||
+           item.offset > size || n > (size - item.offset) / type_width(item.type)){
+            std::cout << "ERROR.MappedPointCloud::open(): column " << k << " of " << file_path << " is invalid.\n";
+            return false;
+        }
+        columns[k].name.assign(item.name, strnlen(item.name, PCB_NAME_SIZE));
+        columns[k].type = item.type;
+        columns[k].data = data + item.offset;
+    }
+
+    // step 03. read the chunk index
+    std::vector<PointChunk> chunks;
+    if(header.chunk_size != 0 && n != 0){
+        size_t cnt = (n + header.chunk_size - 1) / header.chunk_size;
+        if(header.chunks_offset % sizeof(double) != 0 || header.chunks_offset > size ||
+           cnt > (size - header.chunks_offset) / (6 * sizeof(double))){
+            std::cout << "ERROR.MappedPointCloud::open(): chunk index of " << file_path << " is invalid.\n";
+            return false;
+        }
+        const double* boxes = reinterpret_cast<const double*>(data + header.chunks_offset);
+        chunks.resize(cnt);
+        for(size_t i = 0; i < cnt; i++){
+            chunks[i].first = i * header.chunk_size;
+            chunks[i].count = std::min<size_t>(header.chunk_size, n - chunks[i].first);
+            std::copy(boxes + 6 * i, boxes + 6 * i + 3, chunks[i].min);
+            std::copy(boxes + 6 * i + 3, boxes + 6 * i + 6, chunks[i].max);
+        }
+    }
+
+    _file = std::move(file);
+    _columns.swap(columns);
+    _chunks.swap(chunks);
+    _count = n;
+    std::copy(header.bbox, header.bbox + 6, _bbox);
+    return true;
+}
+
+void MappedPointCloud::close()
+{
+    _columns.clear();
+    _chunks.clear();
+    _file.reset();
+    _count = 0;
+    std::fill(_bbox, _bbox + 6, 0.0);
+}
+
+bool MappedPointCloud::has_column(const std::string& name) const
+{
+    for(auto& column : _columns){
+        if(column.name == name) return true;
+    }
+    return false;
+}
+
+const double* MappedPointCloud::column(const std::string& name)
+{
+    for(auto& column : _columns){
+        if(column.name != name) continue;
+        if(column.type == PCB_FLOAT64) return reinterpret_cast<const double*>(column.data);
+        if(column.widened.size() != _count){
+            const float* values = reinterpret_cast<const float*>(column.data);
+            column.widened.assign(values, values + _count);
+        }
+        return column.widened.data();
+    }
+    return nullptr;
+}
+
+bool MappedPointCloud::load(PointCloud& cloud)
+{
+    if(!has_column("x") || !has_column("y")){
+        std::cout << "ERROR.MappedPointCloud::load(): x or y column is missing.\n";
+        return false;
+    }
+    cloud.clear();
+    for(auto& column : _columns){
+        const double* values = this->column(column.name);
+        std::vector<double>* target = nullptr;
+        if(column.name == "x") target = &cloud.x;
+        else if(column.name == "y") target = &cloud.y;
+        else if(column.name == "z") target = &cloud.z;
+        else if(column.name == "s") target = &cloud.s;
+        else target = &cloud.channel(column.name);
+        target->assign(values, values + _count);
+    }
+    return true;
+}
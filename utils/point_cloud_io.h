@@ -0,0 +1,134 @@
+// @Description: Point Cloud File Reader and Writer
+// @Time       : 2026/10/19 10:20
+// @Author     : tongjx
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "point_cloud.h"
+
+namespace asfit
+{
+    /**
+     * READ XYZ
+     * 
+     * Description: 
+     *    read an ASCII point file with one point "x y z [extra columns...]" per line,
+     *    the file is memory-mapped, split into chunks at line breaks and the chunks are
+     *    parsed in parallel straight into the arrays of the cloud
+     *    NOTE: 1. columns are separated by spaces, tabs or commas
+     *          2. lines with less than 3 numbers or with a non-number column are skipped
+     * Parameters:
+     *    @file_path: path of the point file
+     *    @cloud:     [x], [y], [z] of the points, and the named extra columns as channels
+     *    @columns:   channel names of the extra columns after z, e.g. {"r", "g", "b", "intensity"},
+     *                extra columns without a name are dropped, missing values are 0
+     *    @workers:   0 as default, the number of hardware threads
+     * Return:
+     *    true if reading success, otherwise return false
+    */
+    bool read_xyz(
+        const std::string& file_path,
+        PointCloud& cloud,
+        const std::vector<std::string>& columns = {},
+        size_t workers = 0
+    );
+
+    /* Value type of a binary column. */
+    enum ColumnType : uint32_t { PCB_FLOAT64 = 0, PCB_FLOAT32 = 1 };
+
+    /* Points [first, first + count) of a binary file and their bounding box. */
+    struct PointChunk
+    {
+        size_t first = 0;
+        size_t count = 0;
+        double min[3] = {0.0, 0.0, 0.0};
+        double max[3] = {0.0, 0.0, 0.0};
+    };
+
+    /**
+     * WRITE PCB
+     * 
+     * Description: 
+     *    write the cloud into the binary columnar point cloud format (.pcb):
+     *    a header with the point count and the bounding box, a table of named columns,
+     *    every column stored contiguously and 64 byte aligned, and an optional chunk index
+     *    NOTE: 1. the values are stored in the byte order of the host
+     *          2. x, y, z and s are always float64, UTM coordinates do not fit into float32
+     * Parameters:
+     *    @file_path:        path of the binary file
+     *    @cloud:            [x], [y], optional [z], [s] and the channels of the points
+     *    @float32_channels: false as default, store the channels as float32
+     *    @chunk_size:       0 as default, points per chunk of the chunk index, 0 for no index,
+     *                       at most 2^32 - 1
+     * Return:
+     *    true if writing success, otherwise return false
+    */
+    bool write_pcb(
+        const std::string& file_path,
+        const PointCloud& cloud,
+        bool float32_channels = false,
+        size_t chunk_size = 0
+    );
+
+    class MappedFile;
+
+    /**
+     * MAPPED POINT CLOUD
+     * 
+     * Description: 
+     *    memory-mapped reader of the binary columnar point cloud format,
+     *    float64 columns are handed out as pointers into the mapping without copy,
+     *    float32 columns are widened into an owned buffer on first access
+     *    NOTE: the pointers stay valid until close() or destruction
+     */
+    class MappedPointCloud
+    {
+    public:
+        MappedPointCloud();
+        ~MappedPointCloud();
+        MappedPointCloud(const MappedPointCloud&) = delete;
+        MappedPointCloud& operator=(const MappedPointCloud&) = delete;
+
+    public:
+        bool open(const std::string& file_path);
+        void close();
+
+        size_t size() const { return _count; }
+        // xmin, ymin, zmin, xmax, ymax, zmax of the points
+        const double* bbox() const { return _bbox; }
+        // empty if the file was written without chunk index
+        const std::vector<PointChunk>& chunks() const { return _chunks; }
+
+    public:
+        bool has_column(const std::string& name) const;
+        // size() values of the column, nullptr if not exists
+        const double* column(const std::string& name);
+        const double* x() { return column("x"); }
+        const double* y() { return column("y"); }
+        const double* z() { return column("z"); }
+        const double* s() { return column("s"); }
+        // copy all columns into a cloud, columns other than x, y, z and s become channels
+        bool load(PointCloud& cloud);
+
+    private:
+        struct Column
+        {
+            std::string name;
+            uint32_t type = PCB_FLOAT64;
+            const char* data = nullptr;
+            std::vector<double> widened;
+        };
+
+    private:
+        std::unique_ptr<MappedFile> _file;
+        std::vector<Column> _columns;
+        std::vector<PointChunk> _chunks;
+        size_t _count = 0;
+        double _bbox[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    };
+}
@@ -0,0 +1,89 @@
+#include <cstring>
+#include <numeric>
+#include <algorithm>
+
+#include "radix_sort.h"
+
+using namespace asfit;
+
+namespace
+{
+    const int DIGIT_BITS = 11;
+    const size_t BUCKETS = size_t(1) << DIGIT_BITS;
+    const size_t MIN_RADIX_KEYS = 1024;     // fewer keys are sorted by comparison
+    const size_t MIN_CHUNK_KEYS = 1 << 15;  // keys of a chunk at least, smaller chunks do not pay the workers
+
+    /* Order-preserving map of a double to an unsigned integer, -0.0 is mapped as 0.0. */
+    inline uint64_t ordered_bits(double key)
+    {
+        key += 0.0;
+        uint64_t u;
+        std::memcpy(&u, &key, sizeof(u));
+        return (u >> 63) ? ~u : (u | (uint64_t(1) << 63));
+    }
+}
+
+void RadixSort::sort(const double* keys, size_t n, std::vector<size_t>& order, ThreadPool* pool)
+{
+    order.resize(n);
+    std::iota(order.begin(), order.end(), size_t(0));
+    if(n < MIN_RADIX_KEYS){
+        std::stable_sort(order.begin(), order.end(), [keys](const size_t& a, const size_t& b){
+            return keys[a] < keys[b];
+        });
+        return;
+    }
+
+    // step 01. contiguous chunks, one per worker as long as they are large enough
+    size_t chunks = 1;
+    if(pool) chunks = std::max<size_t>(1, std::min(pool->workers(), n / MIN_CHUNK_KEYS));
+    auto each_chunk = [&](const std::function<void(size_t, size_t, size_t)>& task){
+        if(chunks == 1){
+            task(0, 0, n);
+            return;
+        }
+        pool->run(chunks, [&](size_t c, size_t){ task(c, n * c / chunks, n * (c + 1) / chunks); });
+    };
+
+    // step 02. order-preserving integer keys
+    _keys.resize(n);
+    _swap_keys.resize(n);
+    _swap_order.resize(n);
+    _counts.resize(chunks * BUCKETS);
+    each_chunk([&](size_t, size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++) _keys[i] = ordered_bits(keys[i]);
+    });
+
+    // step 03. stable LSD passes, from the lowest digit to the highest
+    for(int shift = 0; shift < 64; shift += DIGIT_BITS){
+        each_chunk([&](size_t c, size_t begin, size_t end){
+            size_t* counts = &_counts[c * BUCKETS];
+            std::fill(counts, counts + BUCKETS, size_t(0));
+            for(size_t i = begin; i < end; i++) ++counts[(_keys[i] >> shift) & (BUCKETS - 1)];
+        });
+        // digit d of chunk c starts after all the smaller digits and the digit d of the previous chunks
+        size_t offset = 0;
+        bool trivial = false;
+        for(size_t d = 0; d < BUCKETS; d++){
+            size_t total = 0;
+            for(size_t c = 0; c < chunks; c++){
+                size_t count = _counts[c * BUCKETS + d];
+                _counts[c * BUCKETS + d] = offset + total;
+                total += count;
+            }
+            if(total == n) trivial = true;
+            offset += total;
+        }
+        if(trivial) continue;
+        each_chunk([&](size_t c, size_t begin, size_t end){
+            size_t* offsets = &_counts[c * BUCKETS];
+            for(size_t i = begin; i < end; i++){
+                size_t pos = offsets[(_keys[i] >> shift) & (BUCKETS - 1)]++;
+                _swap_keys[pos] = _keys[i];
+                _swap_order[pos] = order[i];
+            }
+        });
+        _keys.swap(_swap_keys);
+        order.swap(_swap_order);
+    }
+}
@@ -0,0 +1,51 @@
+// @Description: Parallel Radix Sort of Indices by Double Keys
+// @Time       : 2026/10/19 15:10
+// @Author     : tongjx
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.h"
+
+namespace asfit
+{
+    /**
+     * RADIX SORT
+     *
+     * Description:
+     *    indices of double keys in ascending order, equal keys keep ascending indices,
+     *    the same order as std::sort with (key[a] < key[b] || (key[a] == key[b] && a < b)).
+     *    The keys are mapped to order-preserving 64 bit integers and sorted by LSD radix
+     *    passes of 11 bits, passes where all keys share the digit are skipped.
+     *    With a pool every pass counts and scatters contiguous chunks on the workers.
+     *    The buffers are kept by the object, repeated sorts of similar size do not allocate.
+     */
+    class RadixSort
+    {
+    public:
+        RadixSort(){}
+        ~RadixSort(){}
+
+    public:
+        /**
+         * SORT
+         *
+         * Description:
+         *    order[i] is the index of the i-th smallest key
+         * Parameters:
+         *    @keys:  n keys, NAN is not allowed
+         *    @n:     number of keys
+         *    @order: sorted indices, resized to n
+         *    @pool:  nullptr as default, workers to sort on, or the calling thread only
+         */
+        void sort(const double* keys, size_t n, std::vector<size_t>& order, ThreadPool* pool = nullptr);
+
+    private:
+        std::vector<uint64_t> _keys, _swap_keys;
+        std::vector<size_t> _swap_order;
+        std::vector<size_t> _counts;    // _counts[chunk * BUCKETS + digit]
+    };
+}
@@ -0,0 +1,112 @@
+#include "thread_pool.h"
+
+using namespace asfit;
+
+ThreadPool::ThreadPool(size_t workers)
+{
+    if(workers == 0) workers = std::thread::hardware_concurrency();
+    if(workers == 0) workers = 1;
+    for(size_t i = 0; i < workers; i++) _ranges.emplace_back(new Range());
+    for(size_t i = 0; i < workers; i++) _threads.emplace_back(&ThreadPool::worker_loop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _start.notify_all();
+    for(auto& thread : _threads) thread.join();
+}
+
+void ThreadPool::run(size_t n, const std::function<void(size_t, size_t)>& task)
+{
+    if(n == 0) return;
+    std::lock_guard<std::mutex> run_lock(_run_mutex);
+    std::unique_lock<std::mutex> lock(_mutex);
+    size_t workers = _threads.size();
+    for(size_t i = 0; i < workers; i++){
+        std::lock_guard<std::mutex> range_lock(_ranges[i]->mutex);
+        _ranges[i]->begin = n * i / workers;
+        _ranges[i]->end = n * (i + 1) / workers;
+    }
+    _task = &task;
+    _error = nullptr;
+    _active = workers;
+    ++_generation;
+    _start.notify_all();
+    _done.wait(lock, [this]{ return _active == 0; });
+    _task = nullptr;
+    if(_error) std::rethrow_exception(_error);
+}
+
+bool ThreadPool::next(size_t id, size_t& index)
+{
+    // own range first
+    {
+        Range& own = *_ranges[id];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if(own.begin < own.end){
+            index = own.begin++;
+            return true;
+        }
+    }
+    // steal the back half of the largest remaining range
+    for(;;){
+        size_t victim = id, remains = 0;
+        for(size_t i = 0; i < _ranges.size(); i++){
+            std::lock_guard<std::mutex> lock(_ranges[i]->mutex);
+            if(_ranges[i]->end - _ranges[i]->begin > remains){
+                remains = _ranges[i]->end - _ranges[i]->begin;
+                victim = i;
+            }
+        }
+        if(remains == 0) return false;
+        size_t begin = 0, end = 0;
+        {
+            Range& range = *_ranges[victim];
+            std::lock_guard<std::mutex> lock(range.mutex);
+            if(range.begin >= range.end) continue;
+            size_t mid = range.end - (range.end - range.begin + 1) / 2;
+            begin = mid;
+            end = range.end;
+            range.end = mid;
+        }
+        index = begin;
+        Range& own = *_ranges[id];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.begin = begin + 1;
+        own.end = end;
+        return true;
+    }
+}
+
+void ThreadPool::worker_loop(size_t id)
+{
+    size_t generation = 0;
+    for(;;){
+        const std::function<void(size_t, size_t)>* task = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _start.wait(lock, [&]{ return _stop || _generation != generation; });
+            if(_stop) return;
+            generation = _generation;
+            task = _task;
+        }
+        size_t index = 0;
+        while(next(id, index)){
+            try{
+                (*task)(index, id);
+            }
+            catch(...){
+                std::lock_guard<std::mutex> lock(_mutex);
+                if(!_error) _error = std::current_exception();
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if(--_active == 0) _done.notify_all();
+        }
+    }
+}
@@ -0,0 +1,73 @@
+// @Description: Work-Stealing Thread Pool
+// @Time       : 2026/10/18 15:40
+// @Author     : tongjx
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+namespace asfit
+{
+    /**
+     * THREAD POOL
+     *
+     * Description:
+     *    persistent workers running batches of indexed tasks,
+     *    each worker starts with a contiguous range of the task indices and
+     *    steals half of the remaining range of another worker when its own runs out
+     * Parameters:
+     *    @workers: 0 as default, the number of hardware threads
+     */
+    class ThreadPool
+    {
+    public:
+        explicit ThreadPool(size_t workers = 0);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+    public:
+        size_t workers() const { return _threads.size(); }
+        /**
+         * RUN
+         *
+         * Description:
+         *    call task(index, worker) for every index in [0, n) and wait for all of them,
+         *    worker in [0, workers()) identifies the calling thread, e.g. to pick its scratch buffers,
+         *    the first exception thrown by a task is rethrown here,
+         *    concurrent callers are served one batch at a time
+         *    NOTE: calling run() of the same pool from inside a task deadlocks
+         */
+        void run(size_t n, const std::function<void(size_t, size_t)>& task);
+
+    private:
+        void worker_loop(size_t id);
+        bool next(size_t id, size_t& index);
+
+    private:
+        struct Range
+        {
+            std::mutex mutex;
+            size_t begin = 0;
+            size_t end = 0;
+        };
+        std::vector<std::thread> _threads;
+        std::vector<std::unique_ptr<Range>> _ranges;
+        std::mutex _run_mutex;  // held by run() for the whole batch
+        std::mutex _mutex;
+        std::condition_variable _start;
+        std::condition_variable _done;
+        const std::function<void(size_t, size_t)>* _task = nullptr;
+        size_t _generation = 0;
+        size_t _active = 0;
+        bool _stop = false;
+        std::exception_ptr _error;
+    };
+}